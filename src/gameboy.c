@@ -6,130 +6,113 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
+#ifndef HEADLESS
 #include <SDL2/SDL.h>
+#endif
 
 #include "hardware/cpu.h"
 #include "hardware/memory.h"
 #include "hardware/ppu.h"
 #include "hardware/timer.h"
 #include "hardware/joypad.h"
+#include "hardware/serial.h"
+#include "hardware/emulator.h"
+#include "hardware/disasm.h"
 
+#ifndef HEADLESS
 #include "gui/microui.h"
 #include "gui/renderer.h"
+#include "gui/redraw.h"
+#endif
 
-#define FRAME_RATE_HZ 59.7
-#define CYCLES_PER_FRAME (CLOCK_FREQ_HZ / FRAME_RATE_HZ)
-#define NANOSECONDS_PER_FRAME (1000000000L / FRAME_RATE_HZ)
-
+#include "system/pacing.h"
+#include "system/link_socket.h"
+#include "system/explore.h"
+#include "system/shm_export.h"
+#include "system/control.h"
+#include "system/upscale.h"
+#include "system/present.h"
+#include "system/capture.h"
+
+#if defined(HEADLESS) && defined(DEBUGGER_MODE)
+#error "The debugger needs SDL, it cannot be built headless"
+#endif
 
+#define FRAME_RATE_HZ (CLOCK_FREQ_HZ / (double)CYCLES_PER_FRAME) // 59.73 Hz
 
-uint32_t framebuffer[USER_WINDOW_HEIGHT][USER_WINDOW_WIDTH] = {0};
 
 
-/* This function will be transformed in a callback for the final user in order 
-   to display data to the screen */
-void process_frame_buffer(int x, int y, uint8_t color){
-    uint32_t final_color;
-    switch(color){
-        case 0x00: final_color = 0xFFFFFFFF; break;
-        case 0x01: final_color = 0xC0C0C0C0; break;
-        case 0x02: final_color = 0x2C2C2C2C; break;
-        case 0x03: final_color = 0x00000000; break;
-    }
-
-    for(int i = 0; i<SCALE_FACTOR; i++){
-        for(int j=0; j<SCALE_FACTOR; j++){
-            framebuffer[SCALE_FACTOR*y+i][SCALE_FACTOR*x+j] = final_color;
-        }
-    }
-};
+#ifdef DEBUGGER_MODE
+static uint32_t framebuffer[USER_WINDOW_HEIGHT * USER_WINDOW_WIDTH]; // upscaled frame drawn as an image inside the debugger UI
+static BREAKPOINTS breakpoints;
+static DISASM_CACHE disasm;
+#endif
 
+/* Where the PPU output goes while a frame is emulated: the texture memory of
+   the window when it is shown as it is, native_frame when it is upscaled on 
+   the CPU after it is complete. NULL when nothing is displayed. */
+#ifndef HEADLESS
+static uint32_t native_frame[WINDOW_HEIGHT][WINDOW_WIDTH];
+#endif
+static UPSCALER upscaler;
+static PRESENTER presenter; // frames from the emulation thread to the window, with --present=async
+static bool present_async = false;
+#ifndef HEADLESS
+static uint64_t displayed_frames = 0;
+
+/* Key events polled by the window thread for the emulation thread with 
+   --present=async. The window thread writes head, the emulation thread tail.
+   A quit is not queued so it is never lost to a full queue. */
+#define INPUT_QUEUE_SIZE 64 // a power of 2
+static SDL_Event input_events[INPUT_QUEUE_SIZE];
+static _Atomic uint32_t input_head, input_tail;
+static atomic_bool quit_requested;
+static atomic_bool emulation_done;
+#endif
+static FRAME_HISTOGRAM emulation_time; // run time of the displayed frames on the emulation thread
+static uint32_t *frame_pixels;
+static int frame_pitch;          // pixels in a row of frame_pixels
+static int frame_pixels_written; // a frame where the LCD was on writes all of them
 
-/* This function allows the cpu to correctly handle interrupts */
-int handleInterrupts(CPU *cpu){
-    uint8_t IE = ReadMem(IE_REG);
-    uint8_t IF = ReadMem(IF_REG);
+static SHM_EXPORT shm_export; // frames and WRAM for other processes, with --shm=<name>
+static CONTROL control = { .server_fd = -1, .client_fd = -1 }; // remote control, with --control=<path>
+static CAPTURE capture;         // recording with --record=<path>, screenshots
+static TRACER tracer;           // execution trace, with --trace=<path>
+static uint64_t frames_run = 0;
+static int frame_cycle = 0;     // reached in the frame being emulated, not 0 while a breakpoint holds it
 
-    uint8_t requested = IE & IF;
+/* Startup times for --startup-stats, in ns from the start of main */
+static uint64_t startup_ns, boot_ns, rom_load_ns, first_frame_ns;
 
-    if(!cpu->IME){
-        if(requested != 0) cpu->halted = false; // pending interrupt wakes up cpu
-        return 0;
-    }
 
+static const uint32_t shade_colors[4] = { 0xFFFFFFFF, 0xC0C0C0C0, 0x2C2C2C2C, 0x00000000 };
 
-    if (requested == 0) {
-        return 0;
+/* This function will be transformed in a callback for the final user in order 
+   to display data to the screen */
+void process_frame_buffer(int x, int y, uint8_t color){
+    if(frame_pixels != NULL){
+        frame_pixels[y * frame_pitch + x] = shade_colors[color & 0x03];
+        frame_pixels_written++;
     }
 
-    // An interrupt is happening, so the CPU is no longer halted
-    cpu->halted = false;
-    cpu->IME = false; // Disable further interrupts
-
-    // Push PC to the stack
-    cpu->SP -= 2;
-    WriteMem(cpu->SP, (uint8_t)(cpu->PC & 0xFF));
-    WriteMem(cpu->SP + 1, (uint8_t)(cpu->PC >> 8));
+    if(control.server_fd >= 0) control_pixel(&control, x, y, color);
+    if(capture.active) capture_pixel(&capture, x, y, color);
 
-    // Check interrupts in order of priority
-    if (requested & 0x01) { // V-Blank
-        memory[IF_REG] &= ~0x01; // Clear the request flag
-        cpu->PC = 0x0040;
-    } else if (requested & 0x02) { // LCD STAT
-        memory[IF_REG] &= ~0x02;
-        cpu->PC = 0x0048;
-    } else if (requested & 0x04) { // Timer
-        memory[IF_REG] &= ~0x04;
-        cpu->PC = 0x0050;
-    } else if (requested & 0x08) { // Serial
-        memory[IF_REG] &= ~0x08;
-        cpu->PC = 0x0058;
-    } else if (requested & 0x10) { // Joypad
-        memory[IF_REG] &= ~0x10;
-        cpu->PC = 0x0060;
+    if(shm_export.region != NULL){
+        shm_export.pixels[y][x] = color;
+        if(x == WINDOW_WIDTH - 1 && y == WINDOW_HEIGHT - 1){ // last pixel, the frame is complete
+            shm_export_publish(&shm_export, &MEM(0xC000));
+        }
     }
+};
 
-    return 20;
-}
-
+/* Frame buffer callback for emulators that are not displayed */
+void discard_frame_buffer(int x, int y, uint8_t color){}
 
-void InitializePowerOnState(CPU *cpu, PPU *ppu){
-    cpu->PC = 0x0000;
-    cpu->SP = 0x0000;
-    cpu->AF = 0x0000;
-    cpu->BC = 0x0000;
-    cpu->DE = 0x0000;
-    cpu->HL = 0x0000;
-    
-    cpu->halted = false;
-    cpu->running = true;
-    cpu->IME = false;
-
-    // Initialize PPU state properly
-    ppu->mode = MODE_2_OAM_SCAN;
-    ppu->cycle_counter = 0;
-    ppu->ly = 0;
-
-    // Initialize I/O registers
-    memory[0xFF00] = 0xCF; // Joypad input
-    memory[TIMA_REG] = 0x00; memory[TMA_REG] = 0x00; memory[TAC_REG] = 0x00;
-    memory[0xFF10] = 0x80; memory[0xFF11] = 0xBF; memory[0xFF12] = 0xF3;
-    memory[0xFF14] = 0xBF; memory[0xFF16] = 0x3F; memory[0xFF17] = 0x00;
-    memory[0xFF19] = 0xBF; memory[0xFF1A] = 0x7F; memory[0xFF1B] = 0xFF;
-    memory[0xFF1C] = 0x9F; memory[0xFF1E] = 0xBF; memory[0xFF20] = 0xFF;
-    memory[0xFF21] = 0x00; memory[0xFF22] = 0x00; memory[0xFF23] = 0xBF;
-    memory[0xFF24] = 0x77; memory[0xFF25] = 0xF3; memory[0xFF26] = 0xF1;
-    memory[0xFF41] = 0x02; // STAT - Start in mode 2 (OAM scan)
-    memory[0xFF42] = 0x00; // SCY
-    memory[0xFF43] = 0x00; // SCX
-    memory[0xFF44] = 0x00; // LY - will be updated by PPU
-    memory[0xFF45] = 0x00; // LYC
-    memory[0xFF47] = 0xE4; // BGP - Better palette: 11 10 01 00
-    memory[0xFF48] = 0xFF; memory[0xFF49] = 0xFF;
-    memory[0xFF4A] = 0x00; memory[0xFF4B] = 0x00;
-    memory[IE_REG] = 0x00;
-}
 
 // Add CPU state debugging
 void print_cpu_state(CPU *cpu) {
@@ -137,23 +120,6 @@ void print_cpu_state(CPU *cpu) {
            cpu->PC, cpu->SP, cpu->AF, cpu->BC, cpu->DE, cpu->HL, cpu->halted, cpu->IME, cpu->running, boot_rom_enabled);
 }
 
-void create_dummy_header() {
-    // This is the correct, official Nintendo logo A
-    uint8_t nintendo_logo[48] = {
-        0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
-        0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
-        0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
-    };
-
-    // Copy the logo data into the correct memory location
-    for (int i = 0; i < 48; ++i) {
-        memory[0x0104 + i] = nintendo_logo[i];
-    }
-
-    // A valid header checksum. The boot ROM also verifies this.
-    memory[0x014D] = 0xEA;
-}
-
 void InitializeBootROM() {
     FILE *bootROM = fopen("gb-bootroms/bin/dmg.bin", "rb");
     if(bootROM){
@@ -162,80 +128,85 @@ void InitializeBootROM() {
     }
 }
 
-void InitializeGameROM(char* romPath) {
-    FILE *program = fopen(romPath, "rb");
-    size_t program_length;
-    if(program){
-        fseek(program, 0, SEEK_END);
-        program_length = ftell(program);
-        fseek(program, 0, SEEK_SET);
-        fread(memory, program_length, 1, program);
-        fclose(program);
+/* The ROM is mapped read only, every emulator running it shares the mapping */
+void InitializeGameROM(CARTRIDGE *cart, char* romPath) {
+    if(!cartridge_load(cart, romPath)){
+        fprintf(stderr, "[ERROR] Cannot open ROM %s\n", romPath);
+        exit(1);
     }
 }
 
-void process_input(SDL_Event *event){
-    if(event->type == SDL_QUIT) exit(EXIT_SUCCESS);
+static CARTRIDGE cartridge, link_peer_cartridge;
+static EMULATOR gb;
+static EMULATOR link_peer; // second player when running with --serial=link:<rom>
+static PACER pacer = {0};
+static VSYNC_CONTROLLER vsync = {0};
+
+static SERIAL_BACKEND serial_backend;
+static LINK_SOCKET link_socket = { .fd = -1 };
+static bool linked = false;
+
+#ifndef HEADLESS
+
+/* Key events collected by a poll happened during the previous frame, which
+   is already over. The first one is applied at the start of the next emulated
+   frame, as it was before the events were timestamped, so nothing waits for
+   a later cycle; the ones after it keep their real spacing from it so a press
+   and a release in the same frame are both seen. first_key_ms is the timestamp
+   of the first key event of the poll, UINT32_MAX until there is one. */
+void process_input(SDL_Event *event, uint32_t *first_key_ms){
+    if(event->type == SDL_QUIT){
+        gb.cpu.running = false; // leave the main loop so that stats and logs are flushed
+        return;
+    }
 
-    bool is_pressed = (event->type == SDL_KEYDOWN);
-    bool button_just_pressed = false;
+    if(event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) return;
+    if(event->key.repeat) return;
 
-    switch (event->key.keysym.sym) {
-        case SDLK_b:    if(is_pressed && !joypad.start)  button_just_pressed = true; joypad.start  = is_pressed; break;
-        case SDLK_v:    if(is_pressed && !joypad.select) button_just_pressed = true; joypad.select = is_pressed; break;
-        case SDLK_m:    if(is_pressed && !joypad.b)      button_just_pressed = true; joypad.b      = is_pressed; break;
-        case SDLK_k:    if(is_pressed && !joypad.a)      button_just_pressed = true; joypad.a      = is_pressed; break;
-        case SDLK_s:    if(is_pressed && !joypad.down)   button_just_pressed = true; joypad.down   = is_pressed; break;
-        case SDLK_w:    if(is_pressed && !joypad.up)     button_just_pressed = true; joypad.up     = is_pressed; break;
-        case SDLK_a:    if(is_pressed && !joypad.left)   button_just_pressed = true; joypad.left   = is_pressed; break;
-        case SDLK_d:    if(is_pressed && !joypad.right)  button_just_pressed = true; joypad.right  = is_pressed; break;
+    if(event->key.keysym.sym == SDLK_F11){
+        if(event->type != SDL_KEYDOWN || !tracer.active) return;
+        tracer.enabled = !tracer.enabled;
+        printf("[INFO] Trace %s\n", tracer.enabled ? "resumed" : "paused");
+        return;
     }
 
-    if(button_just_pressed){ // Request joypad interrupt
-        memory[IF_REG] |= 0x10;
+    if(event->key.keysym.sym == SDLK_F12){
+        if(event->type != SDL_KEYDOWN) return;
+        if(!capture.active && !capture_open(&capture, NULL)){ // started by the first screenshot when not recording
+            fprintf(stderr, "[ERROR] Cannot start the capture thread\n");
+            return;
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "screenshot-%06llu.png", (unsigned long long)frames_run + 1);
+        capture_screenshot(&capture, path); // of the next frame, written by the capture thread
+        return;
     }
-}
-
-/* Copies the status of the emulator inside the buffer, the provided buffer 
-   must be at least 82 bytes
-*/
-void GetEmulatorStatus(char* buf, CPU *cpu){
-    uint8_t a =  cpu->AF >> 8;
-    uint8_t f = (cpu->AF & 0xFF);
-    uint8_t b =  cpu->BC >> 8;
-    uint8_t c = (cpu->BC & 0xFF);
-    uint8_t d =  cpu->DE >> 8;
-    uint8_t e = (cpu->DE & 0xFF);
-    uint8_t h =  cpu->HL >> 8;
-    uint8_t l = (cpu->HL & 0xFF);
-    sprintf(buf, "A: %02X F: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X SP: %04X PC: 00:%04X (%02X %02X %02X %02X)\n", a, f, b, c, d, e, h, l, cpu->SP, cpu->PC, ReadMem(cpu->PC), ReadMem(cpu->PC+1), ReadMem(cpu->PC+2), ReadMem(cpu->PC+3));
-}
 
-#ifdef DEBUG_TEST_LOG
-void InitializeLogger(FILE **logger){
-    *logger = fopen("gameboy.log", "w");
-    if(*logger == NULL){
-        exit(1);
+    JOYPAD_BUTTON button;
+    switch (event->key.keysym.sym) {
+        case SDLK_b:    button = JOYPAD_START;  break;
+        case SDLK_v:    button = JOYPAD_SELECT; break;
+        case SDLK_m:    button = JOYPAD_B;      break;
+        case SDLK_k:    button = JOYPAD_A;      break;
+        case SDLK_s:    button = JOYPAD_DOWN;   break;
+        case SDLK_w:    button = JOYPAD_UP;     break;
+        case SDLK_a:    button = JOYPAD_LEFT;   break;
+        case SDLK_d:    button = JOYPAD_RIGHT;  break;
+        default: return;
     }
-    printf("[INFO] Log file initialized correctly\n");
-}
 
-void EndLogger(FILE **logger){
-    fclose(*logger);
-}
+    uint32_t cycle = 0;
+    uint32_t timestamp = event->key.timestamp;
+    if(*first_key_ms == UINT32_MAX) *first_key_ms = timestamp;
+    else if(timestamp > *first_key_ms){
+        uint64_t spacing = (uint64_t)(timestamp - *first_key_ms) * CLOCK_FREQ_HZ / 1000;
+        cycle = spacing < CYCLES_PER_FRAME ? spacing : CYCLES_PER_FRAME - 1;
+    }
 
-void logEmulatorSatus(FILE **logger, CPU *cpu){
-    if(*logger == NULL){
-        printf("logger is NULL\n");
-        exit(1);
+    if(!joypad_push_event(button, event->type == SDL_KEYDOWN, cycle)){
+        joypad_set_button(button, event->type == SDL_KEYDOWN); // queue full, apply it now
     }
-    char buf[128];
-    GetEmulatorStatus(buf, cpu);
-    fprintf(*logger, buf);
 }
-#endif
-
-static CPU cpu = {0};
 
 #ifdef DEBUGGER_MODE
     /* ---- MICROUI STUFF ---- */
@@ -250,6 +221,7 @@ static CPU cpu = {0};
     mu_Context ctx = {0};
     static float bg[3] = { 90, 95, 100 };
     static char buffer[128] = {0};
+    static char pacing_stats[128] = {0};
 
     static void test_window(mu_Context *ctx) {
     /* do window */
@@ -283,7 +255,7 @@ static CPU cpu = {0};
             mu_text(ctx, buffer);
             mu_end_panel(ctx);
             if(mu_button(ctx, "GetStatus")){
-                GetEmulatorStatus(buffer, &cpu);
+                GetEmulatorStatus(buffer, &gb.cpu);
             }
         
         }
@@ -294,6 +266,8 @@ static CPU cpu = {0};
             mu_Rect r = mu_layout_next(ctx); 
             mu_Rect t = mu_rect(r.x, r.y, 200, 100);
             mu_draw_rect(ctx, t, mu_color(bg[0], bg[1], bg[2], 255));
+            pacer_get_stats(&pacer, pacing_stats, sizeof(pacing_stats));
+            mu_text(ctx, pacing_stats);
         }
         mu_layout_end_column(ctx);
 
@@ -308,52 +282,528 @@ static CPU cpu = {0};
     }
     }
 
+    static char break_addr[8] = {0};
+    static char break_condition[BREAKPOINT_SOURCE_MAX] = {0};
+    static char break_error[64] = {0};
+    static char cpu_status[128] = {0};
+
+    /* Adds the breakpoint typed in the debugger window */
+    static void add_breakpoint(void) {
+      char *end;
+      unsigned long addr = strtoul(break_addr, &end, 16);
+      if (end == break_addr || *end != '\0' || addr > 0xFFFF) {
+        snprintf(break_error, sizeof(break_error), "Address must be hex, 0000-FFFF");
+      } else if (!breakpoint_add(&breakpoints, addr, break_condition, false)) {
+        snprintf(break_error, sizeof(break_error), breakpoints.count == BREAKPOINT_MAX ? "Too many breakpoints" : "Condition not valid, e.g. A == 3C && [FF44] >= 90");
+      } else {
+        break_error[0] = break_addr[0] = break_condition[0] = '\0';
+      }
+    }
+
+    static int follow_pc = 1;
+    static int followed_pc = -1;
+    static char goto_addr[8] = {0};
+
+    static bool has_breakpoint(uint16_t addr) {
+      if (breakpoints.pages[addr >> 8] == 0) { return false; }
+      for (int i = 0; i < breakpoints.count; i++) {
+        if (breakpoints.list[i].addr == addr && !breakpoints.list[i].temporary) { return true; }
+      }
+      return false;
+    }
+
+    /* Shows the whole address space disassembled. The panel is as tall as
+       all the lines but only the visible ones are laid out, spacers stand
+       for the rest, so scrolling through 64 KB costs the same as one screen. */
+    static void disassembly_panel(mu_Context *ctx) {
+      mu_layout_row(ctx, 3, (int[]) { 90, -70, -1 }, 0);
+      mu_checkbox(ctx, "Follow PC", &follow_pc);
+      int submit = mu_textbox(ctx, goto_addr, sizeof(goto_addr));
+      int go = mu_button(ctx, "Go to") || (submit & MU_RES_SUBMIT);
+
+      int count = disasm_index(&disasm, gb.cpu.PC);
+      int step = ctx->style->size.y + ctx->style->padding * 2 + ctx->style->spacing;
+      mu_Container *cnt = mu_get_container(ctx, "Disassembly");
+      int first = cnt->scroll.y / step;
+      int visible = cnt->body.h / step;
+
+      char *end;
+      unsigned long addr = strtoul(goto_addr, &end, 16);
+      if (go && end != goto_addr && *end == '\0' && addr <= 0xFFFF) {
+        follow_pc = 0;
+        cnt->scroll.y = disasm_find(&disasm, addr) * step;
+      } else if (follow_pc && gb.cpu.PC != followed_pc) {
+        // only when PC leaves the lines on screen, stepping does not move them
+        int line = disasm_find(&disasm, gb.cpu.PC);
+        if (line < first || line >= first + visible) { cnt->scroll.y = mu_max(0, line * step - cnt->body.h / 2); }
+        followed_pc = gb.cpu.PC;
+      }
+      first = mu_min(cnt->scroll.y / step, count);
+      int last = mu_min(first + visible + 2, count);
+
+      mu_layout_row(ctx, 1, (int[]) { -1 }, 260);
+      mu_begin_panel(ctx, "Disassembly");
+      if (first > 0) {
+        mu_layout_row(ctx, 1, (int[]) { -1 }, first * step - ctx->style->spacing);
+        mu_layout_next(ctx);
+      }
+      mu_layout_row(ctx, 1, (int[]) { -1 }, 0);
+      for (int i = first; i < last; i++) {
+        uint16_t pc = disasm.starts[i];
+        const DISASM_LINE *l = disasm_line(&disasm, pc);
+        char bytes[12] = {0};
+        for (int b = 0; b < l->length; b++) { sprintf(bytes + b * 3, "%02X ", l->bytes[b]); }
+        char line[64];
+        snprintf(line, sizeof(line), "%c %02X:%04X  %-9s %s", has_breakpoint(pc) ? '*' : ' ', pc >= 0x4000 && pc < ROM_SIZE, pc, bytes, l->text);
+        mu_Rect r = mu_layout_next(ctx);
+        if (pc == gb.cpu.PC) { mu_draw_rect(ctx, r, ctx->style->colors[MU_COLOR_BUTTONHOVER]); }
+        mu_draw_control_text(ctx, line, r, MU_COLOR_TEXT, 0);
+      }
+      if (last < count) {
+        mu_layout_row(ctx, 1, (int[]) { -1 }, (count - last) * step - ctx->style->spacing);
+        mu_layout_next(ctx);
+      }
+      mu_end_panel(ctx);
+    }
+
+    static void debugger_window(mu_Context *ctx) {
+    if (mu_begin_window(ctx, "Debugger", mu_rect(860, 40, 400, 700))) {
+        bool stopped = breakpoints.stopped;
+        mu_layout_row(ctx, 3, (int[]) { 90, 90, 90 }, 0);
+        if (stopped) {
+          if (mu_button(ctx, "Continue")) { breakpoints_continue(&breakpoints); }
+        } else if (mu_button(ctx, "Pause")) { breakpoints_pause(&breakpoints); }
+        if (mu_button(ctx, "Step") && stopped) { breakpoints_step(&breakpoints); }
+        if (mu_button(ctx, "Step over") && stopped) { breakpoints_step_over(&breakpoints, &gb.cpu); }
+
+        char status[64];
+        const char *insn = disasm_line(&disasm, gb.cpu.PC)->text;
+        if (!stopped) snprintf(status, sizeof(status), "Running");
+        else if (breakpoints.hit >= 0) snprintf(status, sizeof(status), "Breakpoint at %04X  %s", gb.cpu.PC, insn);
+        else snprintf(status, sizeof(status), "Paused at %04X  %s", gb.cpu.PC, insn);
+        mu_layout_row(ctx, 1, (int[]) { -1 }, 0);
+        mu_label(ctx, status);
+        if (stopped) {
+          GetEmulatorStatus(cpu_status, &gb.cpu);
+          mu_layout_row(ctx, 1, (int[]) { -1 }, 40);
+          mu_text(ctx, cpu_status);
+        }
+
+        if (mu_header_ex(ctx, "Breakpoints", MU_OPT_EXPANDED)) {
+          mu_layout_row(ctx, 3, (int[]) { 60, -50, -1 }, 0);
+          int submit = mu_textbox(ctx, break_addr, sizeof(break_addr));
+          submit |= mu_textbox(ctx, break_condition, sizeof(break_condition));
+          if (mu_button(ctx, "Add") || (submit & MU_RES_SUBMIT)) { add_breakpoint(); }
+          if (break_error[0]) {
+            mu_layout_row(ctx, 1, (int[]) { -1 }, 0);
+            mu_label(ctx, break_error);
+          }
+
+          for (int i = 0; i < breakpoints.count; i++) {
+            BREAKPOINT *bp = &breakpoints.list[i];
+            if (bp->temporary) { continue; }
+            char line[128];
+            snprintf(line, sizeof(line), "%s%04X %s%s  hits %llu", i == breakpoints.hit && stopped ? "> " : "",
+                     bp->addr, bp->condition[0] ? "if " : "", bp->condition, (unsigned long long)bp->hits);
+            mu_layout_row(ctx, 2, (int[]) { -70, -1 }, 0);
+            mu_label(ctx, line);
+            mu_push_id(ctx, &i, sizeof(i));
+            int removed = mu_button(ctx, "Remove");
+            mu_pop_id(ctx);
+            if (removed) { breakpoint_remove(&breakpoints, i); break; }
+          }
+        }
+
+        if (mu_header_ex(ctx, "Disassembly", MU_OPT_EXPANDED)) { disassembly_panel(ctx); }
+        mu_end_window(ctx);
+    }
+    }
+
     static void process_frame(mu_Context *ctx) {
         mu_begin(ctx);
         test_window(ctx);
+        debugger_window(ctx);
         mu_end(ctx);
     }
 #endif
 
-int main(int argc, char **argv){
-    if(argc <= 1){
-        fprintf(stderr, "[ERROR] Usage: ./gameboy <path-to-ROM>\n");
-        exit(1);
+#ifdef DEBUGGER_MODE
+    static RedrawState redraw;
+    static uint64_t image_serial = 0; // changes with every emulated frame, the content of the framebuffer image
+
+    /* Draws the microui commands that touch the region, clipped to it */
+    static void redraw_region(mu_Rect region){
+        bool visible = true;
+        r_set_clip_rect(region);
+        r_draw_rect(region, mu_color(bg[0], bg[1], bg[2], 255));
+        mu_Command *cmd = NULL;
+        while (mu_next_command(&ctx, &cmd)) {
+            if (cmd->type == MU_COMMAND_CLIP) {
+                mu_Rect clip = redraw_intersect(cmd->clip.rect, region);
+                visible = clip.w > 0 && clip.h > 0; // SDL takes an empty clip rect as no clipping
+                if (visible) r_set_clip_rect(clip);
+                continue;
+            }
+            if (!visible) continue;
+            switch (cmd->type) {
+                case MU_COMMAND_TEXT: r_draw_text(cmd->text.str, cmd->text.pos, cmd->text.color); break;
+                case MU_COMMAND_RECT: if (redraw_overlaps(cmd->rect.rect, region)) r_draw_rect(cmd->rect.rect, cmd->rect.color); break;
+                case MU_COMMAND_IMAGE: if (redraw_overlaps(cmd->image.rect, region)) r_draw_image(cmd->image.rect, WINDOW_WIDTH * upscaler_factor(&upscaler), WINDOW_HEIGHT * upscaler_factor(&upscaler), cmd->image.framebuffer);break; // the only image is the frame buffer, scaled to the window
+                case MU_COMMAND_ICON: if (redraw_overlaps(cmd->icon.rect, region)) r_draw_icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color); break;
+            }
+        }
     }
-    PPU ppu = {0};
-    ppu.process_frame_buffer = process_frame_buffer;
-    InitializeInstructionTable();
-    InitializePowerOnState(&cpu, &ppu);
-    InitializeBootROM();
-    InitializeGameROM(argv[1]);
+#endif
 
-    #ifdef DEBUG_TEST_LOG
-        FILE *logger = NULL;
-        InitializeLogger(&logger);
+/* Draws the last emulated frame (and the debugger UI) to the window back buffer.
+   The debugger UI is kept in a cached texture and only the regions where the
+   microui commands changed since the previous frame are drawn again. */
+static void render_frame(){
+    #ifdef DEBUGGER_MODE
+        static float drawn_bg[3];
+        int width, height;
+        bool invalidated;
+        bool cached = r_begin_cached(&width, &height, &invalidated);
+        if(!cached || invalidated || memcmp(drawn_bg, bg, sizeof(bg)) != 0) redraw_invalidate(&redraw);
+        memcpy(drawn_bg, bg, sizeof(bg));
+
+        int regions = redraw_update(&redraw, &ctx, width, height, image_serial);
+        for(int i = 0; i < regions; i++) redraw_region(redraw.rects[i]);
+        if(cached) r_end_cached();
+    #else
+        r_clear(mu_color(0, 0, 0, 255));
+        r_draw_frame(NULL);
     #endif
+}
+
+/* Shows a frame published by the emulation thread, called on the window 
+   thread which owns the renderer. The upscale happens here so its cost is not
+   paid by the emulation. */
+static void present_frame(const uint32_t *pixels, int pitch, void *ctx){
+    (void)ctx;
+    int factor = upscaler_factor(&upscaler);
+    int texture_pitch;
+    if(r_begin_frame(WINDOW_WIDTH * factor, WINDOW_HEIGHT * factor)){
+        upscaler_run(&upscaler, pixels, pitch, r_get_frame_pixels(&texture_pitch), texture_pitch);
+        r_end_frame();
+    }
+    render_frame();
+    r_present();
+}
+
+#endif /* HEADLESS */
+
+
+/* Runs one frame of emulation, with the link cable peer if there is one */
+static void run_frame(){
+    if(linked){
+        emulator_run_linked(&gb, &link_peer, CYCLES_PER_FRAME, LINK_QUANTUM_CYCLES);
+    }
+    else{
+        if(link_socket.fd >= 0) link_socket_run(&link_socket, &gb, 0, CYCLES_PER_FRAME);
+        else{
+            frame_cycle = emulator_run(&gb, frame_cycle, CYCLES_PER_FRAME);
+            #ifdef DEBUGGER_MODE
+                if(breakpoints.stopped) return; // the rest of the frame runs when the debugger resumes
+            #endif
+            frame_cycle = 0;
+        }
+        joypad_apply_events(UINT32_MAX); // nothing queued for this frame is carried to the next one
+    }
+    if(serial_backend.flush != NULL) serial_backend.flush(serial_backend.ctx);
+    if(control.server_fd >= 0) control_frame_done(&control);
+    capture_frame_done(&capture);
+    if(frames_run++ == 0) first_frame_ns = pacer_now_ns() - startup_ns;
+}
+
+
+
+/* Runs from the current state every combination of buttons held for the 
+   amount of frames passed, each in a forked child, and prints how many 
+   different outcomes there are */
+static void explore_all_inputs(int frames){
+    static uint8_t masks[EXPLORE_MAX_CHILDREN];
+    static EXPLORE_INPUT inputs[EXPLORE_MAX_CHILDREN];
+    static EXPLORE_RESULT results[EXPLORE_MAX_CHILDREN];
+
+    for(int i = 0; i < EXPLORE_MAX_CHILDREN; i++){
+        masks[i] = i;
+        inputs[i] = (EXPLORE_INPUT){ &masks[i], 1 };
+    }
+
+    uint64_t start = pacer_now_ns();
+    int received = explore_fork(&gb, inputs, EXPLORE_MAX_CHILDREN, frames, sysconf(_SC_NPROCESSORS_ONLN), results);
+    uint64_t elapsed = pacer_now_ns() - start;
+
+    int distinct = 0;
+    for(int i = 0; i < EXPLORE_MAX_CHILDREN; i++){
+        if(results[i].status != 0) continue;
+        bool seen = false;
+        for(int j = 0; j < i && !seen; j++){
+            seen = results[j].status == 0 && results[j].frame_hash == results[i].frame_hash &&
+                   results[j].wram_hash == results[i].wram_hash && results[j].hram_hash == results[i].hram_hash;
+        }
+        if(!seen){
+            distinct++;
+            printf("[EXPLORE] buttons %02X -> PC %04X frame %016llx wram %016llx\n", i, results[i].pc,
+                   (unsigned long long)results[i].frame_hash, (unsigned long long)results[i].wram_hash);
+        }
+    }
+    printf("[EXPLORE] %d/%d children reported, %d distinct outcomes after %d frames, %.1f ms\n",
+           received, EXPLORE_MAX_CHILDREN, distinct, frames, elapsed / 1e6);
+}
+
+
+
+/* Runs the emulator without SDL as fast as possible, for the amount of frames
+   passed or until it stops when frames is 0. With a controller the frames 
+   run when it says so. With a screenshot_path the last frame is saved there. */
+static void run_headless(int frames, const char *screenshot_path){
+    for(int i = 0; (frames == 0 || i < frames) && gb.cpu.running; i++){
+        if(control.server_fd >= 0 && !control_service(&control, &gb, true)) break; // blocks until there is a frame to run
+        if(screenshot_path != NULL && i == frames - 1) capture_screenshot(&capture, screenshot_path);
+        run_frame();
+    }
+}
+
+
+
+/* Prints where the time before the first frame went */
+static void print_startup_stats(bool windowed){
+    printf("[STATS] startup: boot %.3f ms (instruction table, boot ROM, emulator), ROM load %.3f ms\n",
+           boot_ns / 1e6, rom_load_ns / 1e6);
+    #ifndef HEADLESS
+        if(windowed){
+            RendererStartupStats renderer_stats;
+            r_get_startup_stats(&renderer_stats);
+            printf("[STATS] startup: SDL init %.3f ms, window and renderer %.3f ms, ", renderer_stats.sdl_init_ms, renderer_stats.window_ms);
+            if(renderer_stats.font_loaded) printf("font %.3f ms on first use\n", renderer_stats.font_ms);
+            else printf("font never loaded\n");
+        }
+    #endif
+    if(frames_run > 0) printf("[STATS] startup: first frame emulated %.3f ms after start\n", first_frame_ns / 1e6);
+}
+
+
+
+void PrintUsage(){
+    fprintf(stderr, "[ERROR] Usage: ./gameboy [options] <path-to-ROM>\n"
+                    "  --pacing=catchup|drop  policy for frames that overrun their deadline (default catchup)\n"
+                    "  --spin-us=N            busy-wait the last N us before a frame deadline (default 200)\n"
+                    "  --frame-stats          print frame time and jitter statistics on exit\n"
+                    "  --startup-stats        print the time spent in SDL init, font, ROM load and boot\n"
+                    "  --vsync                lock emulation to the display refresh when it is within 0.5%%\n"
+                    "                         (presents on the emulation thread, as --present=sync)\n"
+                    "  --present=async|sync   emulate on a separate thread while the window thread presents\n"
+                    "                         (default) or present after each emulated frame; the debugger\n"
+                    "                         always presents in sync\n"
+                    "  --serial=BACKEND       stdout (default), loopback, file:<path>, link:<second-ROM>,\n"
+                    "                         socket-listen:<path> or socket:<path> (link cable to another process)\n"
+                    "  --link-quantum=N       cycles between two synchronizations of a socket link (default 4096)\n"
+                    "  --shm=NAME             export frames, WRAM and a frame counter in the POSIX shared\n"
+                    "                         memory segment NAME (e.g. /gameboy), see tools/shm_reader.c\n"
+                    "  --control=PATH         accept commands on the Unix socket PATH (pause, step, input,\n"
+                    "                         peek/poke, save/load state, frame hash, trace), see system/control.h;\n"
+                    "                         headless it starts paused\n"
+                    "  --renderer=BACKEND     accelerated (default), software or offscreen (no window), the\n"
+                    "                         next one is used when it does not work\n"
+                    "  --upscale=FILTER       none (default, scaled by the GPU), nearest, scale2x, scale3x or xbr\n"
+                    "                         applied on the CPU to every complete frame\n"
+                    "  --record=PATH          record every frame on a background thread, raw Y4M when PATH ends\n"
+                    "                         in .y4m, otherwise 2bpp+RLE .gbv (tools/capture_convert.c)\n"
+                    "  --screenshot=PATH      headless: save the last of --frames as PNG (F12 in the window)\n"
+                    "  --trace=PATH           record every instruction after the boot ROM in the binary trace\n"
+                    "                         PATH (tools/trace_convert.c, tools/gbtrace_diff.c), F11 or the\n"
+                    "                         control socket pause and resume it\n"
+                    "  --trace-pc=START-END   only trace instructions at these addresses (hex, e.g. 0150-01FF)\n"
+                    "  --trace-cycles=START-END  only trace in this window of cycles from power on\n"
+                    "  --trace-trigger=COND   start tracing when pc:ADDR is reached or mem:ADDR=VALUE holds (hex)\n"
+                    "  --trace-limit=N        stop tracing after N instructions\n"
+                    "  --doctor               LY always reads 0x90, as the gameboy-doctor logs assume, to\n"
+                    "                         compare a trace with them\n"
+                    "  --headless             run without window as fast as possible, never touches SDL\n"
+                    "  --frames=N             stop after N frames (default 0 runs until the CPU stops)\n"
+                    "  --explore=N            after --frames, try all 256 button combinations held for N frames\n"
+                    "                         in forked children and report the distinct outcomes (headless)\n");
+}
+
+#ifndef HEADLESS
+/* Runs one frame and publishes it for the window thread, or without it puts
+   it in the texture of the window. Without an 
+   upscaler the PPU output goes straight into the locked texture memory, 
+   otherwise the complete native frame is upscaled into it. The locked memory 
+   does not keep the previous frame, if the LCD was off for part of the frame
+   the screen is shown blank as the real one does. */
+static void run_displayed_frame(){
+    if(present_async){
+        frame_pixels = presenter_back_buffer(&presenter);
+        frame_pitch  = WINDOW_WIDTH;
+        frame_pixels_written = 0;
+
+        run_frame();
+
+        if(frame_pixels_written < WINDOW_WIDTH * WINDOW_HEIGHT){
+            for(int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++) frame_pixels[i] = shade_colors[0];
+        }
+        presenter_publish(&presenter, ++displayed_frames);
+        frame_pixels = NULL;
+        return;
+    }
 
-    struct timespec start_time, end_time;
-    long sleep_duration_ns;
-    
     #ifdef DEBUGGER_MODE
-        r_init("Gameboy Debugger", USER_WINDOW_WIDTH*2, USER_WINDOW_HEIGHT+200,  "src/gui/fonts/DejaVuSans.ttf");
+        bool direct = false; // the debugger draws the frame as an image of its UI
+    #else
+        bool direct = upscaler.filter == UPSCALE_NONE;
+    #endif
+
+    if(direct){
+        if(r_begin_frame(WINDOW_WIDTH, WINDOW_HEIGHT)) frame_pixels = r_get_frame_pixels(&frame_pitch);
+    }
+    else{
+        frame_pixels = &native_frame[0][0];
+        frame_pitch  = WINDOW_WIDTH;
+    }
+    if(frame_cycle == 0) frame_pixels_written = 0; // otherwise a breakpoint stopped the frame half drawn
+
+    run_frame();
+
+    if(frame_pixels == NULL) return;
+    if(frame_cycle == 0 && frame_pixels_written < WINDOW_WIDTH * WINDOW_HEIGHT){
+        for(int y = 0; y < WINDOW_HEIGHT; y++){
+            for(int x = 0; x < WINDOW_WIDTH; x++) frame_pixels[y * frame_pitch + x] = shade_colors[0];
+        }
+    }
+
+    if(!direct){
+        int factor = upscaler_factor(&upscaler);
+        #ifdef DEBUGGER_MODE
+            upscaler_run(&upscaler, &native_frame[0][0], WINDOW_WIDTH, framebuffer, WINDOW_WIDTH * factor);
+        #else
+            int pitch;
+            if(r_begin_frame(WINDOW_WIDTH * factor, WINDOW_HEIGHT * factor)){
+                upscaler_run(&upscaler, &native_frame[0][0], WINDOW_WIDTH, r_get_frame_pixels(&pitch), pitch);
+            }
+        #endif
+    }
+    r_end_frame();
+    frame_pixels = NULL;
+}
+
+
+
+/* Queues a key event for the emulation thread, dropped when it is 
+   INPUT_QUEUE_SIZE events behind */
+static void input_push(const SDL_Event *event){
+    uint32_t head = atomic_load_explicit(&input_head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&input_tail, memory_order_acquire) == INPUT_QUEUE_SIZE) return;
+    input_events[head % INPUT_QUEUE_SIZE] = *event;
+    atomic_store_explicit(&input_head, head + 1, memory_order_release);
+}
+
+static bool input_pop(SDL_Event *event){
+    uint32_t tail = atomic_load_explicit(&input_tail, memory_order_relaxed);
+    if(tail == atomic_load_explicit(&input_head, memory_order_acquire)) return false;
+    *event = input_events[tail % INPUT_QUEUE_SIZE];
+    atomic_store_explicit(&input_tail, tail + 1, memory_order_release);
+    return true;
+}
+
+
+
+/* Body of the emulation thread with --present=async: applies the key events 
+   of the window thread, emulates, publishes the frame and waits for the next
+   deadline. A present blocked in the driver does not delay it. */
+static void *emulation_thread(void *arg){
+    int frames = *(int *)arg;
+
+    for(int frame = 0; gb.cpu.running && !atomic_load(&quit_requested) && (frames == 0 || frame < frames); frame++){
+        uint32_t first_key_ms = UINT32_MAX;
+        SDL_Event event;
+        while(input_pop(&event)) process_input(&event, &first_key_ms);
+
+        // when paused by the controller the window keeps the last frame
+        if(control.server_fd < 0 || control_service(&control, &gb, false)){
+            uint64_t start = pacer_now_ns();
+            run_displayed_frame();
+            histogram_add(&emulation_time, pacer_now_ns() - start);
+        }
+        pacer_wait(&pacer); // a frame late for the display is replaced by the next one in the triple buffer
+    }
+
+    atomic_store(&emulation_done, true);
+    presenter_wake(&presenter);
+    return NULL;
+}
+
+
+
+/* Runs the emulation on its own thread while this one, which created the 
+   window, keeps the events and the renderer: it polls the events and shows 
+   the frames published in the triple buffer until the emulation stops. 
+   Returns false if the thread cannot be created. */
+static bool run_emulation_thread(int frames){
+    presenter_init(&presenter, present_frame, NULL);
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, emulation_thread, &frames) != 0){
+        presenter_close(&presenter);
+        return false;
+    }
+
+    while(!atomic_load(&emulation_done)){
+        SDL_Event event;
+        while(SDL_PollEvent(&event)){
+            if(event.type == SDL_QUIT) atomic_store(&quit_requested, true);
+            else if(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) input_push(&event);
+        }
+        presenter_show(&presenter, pacer.period_ns); // the events are polled again at least once per frame
+    }
+
+    pthread_join(thread, NULL);
+    presenter_close(&presenter);
+    return true;
+}
+
+
+
+/* Runs the emulator in a window paced to the real Game Boy frame rate. With
+   present_async the emulation runs on its own thread and this one presents,
+   otherwise each frame is presented after it is emulated. frames limits the
+   run like headless, e.g. to benchmark the GUI with --renderer=offscreen or
+   with SDL_VIDEODRIVER=dummy. */
+static void run_windowed(PACING_POLICY pacing_policy, uint64_t spin_ns, bool vsync_enabled, RendererBackend backend, int frames){
+    #ifdef DEBUGGER_MODE
+        backend = r_init("Gameboy Debugger", USER_WINDOW_WIDTH*2, USER_WINDOW_HEIGHT+200,  "src/gui/fonts/DejaVuSans.ttf", vsync_enabled, backend);
         mu_init(&ctx);
         ctx.text_width = text_width;
         ctx.text_height = text_height;
     #else
-        r_init("Gameboy", USER_WINDOW_WIDTH, USER_WINDOW_HEIGHT,  "src/gui/fonts/DejaVuSans.ttf");
+        backend = r_init("Gameboy", USER_WINDOW_WIDTH, USER_WINDOW_HEIGHT,  "src/gui/fonts/DejaVuSans.ttf", vsync_enabled, backend);
     #endif
+    printf("[INFO] Rendering with the %s backend\n", r_backend_name(backend));
 
+    pacer_init(&pacer, FRAME_RATE_HZ, pacing_policy, spin_ns);
+    vsync_init(&vsync, FRAME_RATE_HZ, r_get_refresh_rate());
+    bool present = true;
 
-    while(cpu.running){
-
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
+    if(present_async){
+        if(run_emulation_thread(frames)){
+            r_quit();
+            return;
+        }
+        fprintf(stderr, "[INFO] Cannot start the emulation thread, presenting after each frame\n");
+        present_async = false;
+    }
 
-        int cycles_this_frame = 0;
+    for(int frame = 0; gb.cpu.running && (frames == 0 || frame < frames); frame++){
 
+        uint32_t first_key_ms = UINT32_MAX;
+        bool input = false;   // the debugger UI stays as it is without input or a new frame
+        bool emulated = false;
         SDL_Event event;
             while (SDL_PollEvent(&event)) {
-                process_input(&event);
+                input = true;
+                process_input(&event, &first_key_ms);
                 #ifdef DEBUGGER_MODE
                     switch (event.type) {
                         case SDL_MOUSEMOTION: mu_input_mousemove(&ctx, event.motion.x, event.motion.y); break;
@@ -379,76 +829,294 @@ int main(int argc, char **argv){
                 #endif
             }
 
-        while (cycles_this_frame < CYCLES_PER_FRAME && cpu.running){
-            int cycles_executed = 0;
+        // when paused by the controller or the debugger the window keeps being presented
+        bool running = true;
+        #ifdef DEBUGGER_MODE
+            running = !breakpoints.stopped;
+        #endif
+        if(running && (control.server_fd < 0 || control_service(&control, &gb, false))){
+            uint64_t start = pacer_now_ns();
+            run_displayed_frame();
+            histogram_add(&emulation_time, pacer_now_ns() - start);
+            emulated = true;
+        }
 
-            // First, check if an interrupt needs to be serviced.
-            cycles_executed += handleInterrupts(&cpu);
-            
-            #ifdef DEBUG_TEST_LOG
-                    if(!boot_rom_enabled) logEmulatorSatus(&logger, &cpu);
-            #endif
+        bool draw = present;
+        #ifdef DEBUGGER_MODE
+            // paused without input: the UI is neither built nor drawn, unless the vsync lock needs the present
+            if(!input && !emulated && !(vsync_enabled && vsync.locked) && frame > 0) draw = false;
+            if(emulated) image_serial++;
+        #else
+            (void)input; (void)emulated;
+        #endif
 
-            if (cpu.halted) {
-                cycles_executed += 4;
-            } else {
-                uint8_t opcode = FetchByte(&cpu); 
-                cycles_executed = instruction_table[opcode](&cpu);
+        if(draw){
+            #ifdef DEBUGGER_MODE
+                process_frame(&ctx);
+            #endif
+            // when locked every refresh of the swap interval shows the same emulated frame
+            int refreshes = (vsync_enabled && vsync.locked) ? vsync.swap_interval : 1;
+            for(int i = 0; i < refreshes; i++){
+                render_frame();
+                r_present();
             }
+            if(vsync_enabled) vsync_presented(&vsync, pacer_now_ns());
+        }
 
-            cycles_this_frame += cycles_executed;
+        if(vsync_enabled && vsync.locked) pacer_mark_frame(&pacer); // the blocking present already paced this frame
+        else present = pacer_wait(&pacer);
+    }
+    r_quit();
+}
+#endif
 
-            ppu_step(&ppu, cycles_executed);
-            timer_step(cycles_executed);
-            dma_step(cycles_executed);
+/* Runs in the explore children right after the fork. They only have the
+   thread that forked them, the capture thread stayed in the parent. */
+static void forget_capture_in_child(void){
+    capture.active = false;
+}
 
-            // DEBUG INFO Written to serial data output by tests printend on console
-            if(memory[0xFF01] >= 0 && memory[0xFF01] <= 127 && memory[0xFF02] == 0x81){
-                printf("%c",memory[0xFF01]);
-                memory[0xFF02] = 0;
+int main(int argc, char **argv){
+    startup_ns = pacer_now_ns();
+    char *rom_path = NULL;
+    PACING_POLICY pacing_policy = PACING_CATCH_UP;
+    uint64_t spin_ns = PACER_SPIN_NS_DEFAULT;
+    bool frame_stats = false;
+    bool startup_stats = false;
+    bool vsync_enabled = false;
+    char *serial_option = "stdout";
+    int link_quantum = LINK_SOCKET_QUANTUM_DEFAULT;
+    bool headless = false;
+    int frames = 0;
+    int explore_frames = 0;
+    char *shm_name = NULL;
+    char *control_path = NULL;
+    UPSCALE_FILTER upscale_filter = UPSCALE_NONE;
+    #ifndef HEADLESS
+        RendererBackend backend = R_BACKEND_ACCELERATED;
+    #endif
+    bool present_sync = false;
+    char *record_path = NULL;
+    char *screenshot_path = NULL;
+    char *trace_path = NULL;
+    TRACE_FILTER trace_filter;
+    trace_filter_init(&trace_filter);
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--pacing=catchup") == 0)   pacing_policy = PACING_CATCH_UP;
+        else if(strcmp(argv[i], "--pacing=drop") == 0) pacing_policy = PACING_DROP;
+        else if(strncmp(argv[i], "--spin-us=", 10) == 0) spin_ns = strtoull(argv[i] + 10, NULL, 10) * 1000;
+        else if(strcmp(argv[i], "--frame-stats") == 0)  frame_stats = true;
+        else if(strcmp(argv[i], "--startup-stats") == 0) startup_stats = true;
+        else if(strcmp(argv[i], "--vsync") == 0)        vsync_enabled = true;
+        else if(strncmp(argv[i], "--serial=", 9) == 0)  serial_option = argv[i] + 9;
+        else if(strncmp(argv[i], "--link-quantum=", 15) == 0) link_quantum = atoi(argv[i] + 15);
+        else if(strncmp(argv[i], "--shm=", 6) == 0)    shm_name = argv[i] + 6;
+        else if(strncmp(argv[i], "--control=", 10) == 0) control_path = argv[i] + 10;
+        else if(strcmp(argv[i], "--present=async") == 0) present_sync = false;
+        else if(strcmp(argv[i], "--present=sync") == 0)  present_sync = true;
+        else if(strncmp(argv[i], "--record=", 9) == 0) record_path = argv[i] + 9;
+        else if(strncmp(argv[i], "--screenshot=", 13) == 0) screenshot_path = argv[i] + 13;
+        #ifndef HEADLESS
+        else if(strncmp(argv[i], "--renderer=", 11) == 0){
+            if(!r_parse_backend(argv[i] + 11, &backend)){
+                PrintUsage();
+                exit(1);
             }
-
-            
         }
-        
-
-        #ifdef DEBUGGER_MODE
-            r_clear(mu_color(bg[0], bg[1], bg[2], 255));
-            process_frame(&ctx);
-            mu_Command *cmd = NULL;
-            while (mu_next_command(&ctx, &cmd)) {
-                switch (cmd->type) {
-                    case MU_COMMAND_TEXT: r_draw_text(cmd->text.str, cmd->text.pos, cmd->text.color); break;
-                    case MU_COMMAND_RECT: r_draw_rect(cmd->rect.rect, cmd->rect.color); break;
-                    case MU_COMMAND_IMAGE: r_draw_image(cmd->image.rect, cmd->image.rect.w, cmd->image.rect.h, cmd->image.framebuffer);break;
-                    case MU_COMMAND_ICON: r_draw_icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color); break;
-                    case MU_COMMAND_CLIP: r_set_clip_rect(cmd->clip.rect); break;
-                }
-            }
-        #else
-            r_clear(mu_color(0, 0, 0, 255));
-            mu_Rect r = mu_rect(0,0,USER_WINDOW_WIDTH, USER_WINDOW_HEIGHT);
-            r_draw_image(r, USER_WINDOW_WIDTH, USER_WINDOW_HEIGHT, (const uint32_t *)framebuffer);
         #endif
-        r_present();
+        else if(strncmp(argv[i], "--upscale=", 10) == 0){
+            if(!upscale_parse_filter(argv[i] + 10, &upscale_filter)){
+                PrintUsage();
+                exit(1);
+            }
+        }
+        else if(strncmp(argv[i], "--trace=", 8) == 0)  trace_path = argv[i] + 8;
+        else if(strncmp(argv[i], "--trace-pc=", 11) == 0){
+            uint64_t min = trace_filter.pc_min, max = trace_filter.pc_max;
+            if(!trace_parse_range(argv[i] + 11, 16, &min, &max) || max > 0xFFFF){
+                PrintUsage();
+                exit(1);
+            }
+            trace_filter.pc_min = min;
+            trace_filter.pc_max = max;
+        }
+        else if(strncmp(argv[i], "--trace-cycles=", 15) == 0){
+            if(!trace_parse_range(argv[i] + 15, 10, &trace_filter.cycle_min, &trace_filter.cycle_max)){
+                PrintUsage();
+                exit(1);
+            }
+        }
+        else if(strncmp(argv[i], "--trace-trigger=", 16) == 0){
+            if(!trace_parse_trigger(argv[i] + 16, &trace_filter)){
+                PrintUsage();
+                exit(1);
+            }
+        }
+        else if(strncmp(argv[i], "--trace-limit=", 14) == 0) trace_filter.limit = strtoull(argv[i] + 14, NULL, 10);
+        else if(strcmp(argv[i], "--doctor") == 0) doctor_ly = true;
+        else if(strcmp(argv[i], "--headless") == 0)     headless = true;
+        else if(strncmp(argv[i], "--frames=", 9) == 0)  frames = atoi(argv[i] + 9);
+        else if(strncmp(argv[i], "--explore=", 10) == 0) explore_frames = atoi(argv[i] + 10);
+        else if(strncmp(argv[i], "--", 2) == 0){
+            PrintUsage();
+            exit(1);
+        }
+        else rom_path = argv[i];
+    }
+
+    #ifdef HEADLESS
+        headless = true;
+    #endif
+    if(explore_frames > 0) headless = true;
+
+    // the vsync lock paces the emulation with the blocking present, the debugger UI is built on the emulation thread
+    present_async = !headless && !present_sync && !vsync_enabled;
+    #ifdef DEBUGGER_MODE
+        present_async = false;
+        breakpoints_init(&breakpoints);
+        disasm_init(&disasm);
+    #endif
+
+    if(rom_path == NULL){
+        PrintUsage();
+        exit(1);
+    }
+    uint64_t boot_start = pacer_now_ns();
+    InitializeInstructionTable();
+    InitializeBootROM();
+    upscaler_init(&upscaler, upscale_filter);
+    boot_ns = pacer_now_ns() - boot_start;
+
+    static SERIAL_BACKEND link_peer_backend;
+    static SERIAL_CAPTURE serial_capture;
+    static SERIAL_LINK link_ends[2];
+    linked = strncmp(serial_option, "link:", 5) == 0;
+
+    uint64_t rom_start = pacer_now_ns();
+    InitializeGameROM(&cartridge, rom_path);
+    if(linked){
+        // two copies of the same game run on the same ROM
+        if(strcmp(serial_option + 5, rom_path) == 0) link_peer_cartridge = cartridge;
+        else InitializeGameROM(&link_peer_cartridge, serial_option + 5);
+    }
+    rom_load_ns = pacer_now_ns() - rom_start;
 
-        clock_gettime(CLOCK_MONOTONIC, &end_time);
-        long time_elapsed_ns = (end_time.tv_sec - start_time.tv_sec) * 1000000000L +
-                               (end_time.tv_nsec - start_time.tv_nsec);
+    boot_start = pacer_now_ns();
+    if(linked) emulator_init(&link_peer, &link_peer_cartridge, discard_frame_buffer);
+    emulator_init(&gb, &cartridge, process_frame_buffer);
+    #ifdef DEBUGGER_MODE
+        emulator_set_breakpoints(&gb, &breakpoints);
+    #endif
+    boot_ns += pacer_now_ns() - boot_start;
 
-        sleep_duration_ns = NANOSECONDS_PER_FRAME - time_elapsed_ns;
+    if(strcmp(serial_option, "stdout") == 0){
+        serial_capture_init(&serial_backend, &serial_capture, stdout);
+    }
+    else if(strcmp(serial_option, "loopback") == 0){
+        serial_loopback_init(&serial_backend);
+    }
+    else if(strncmp(serial_option, "file:", 5) == 0){
+        FILE *serial_file = fopen(serial_option + 5, "wb");
+        if(serial_file == NULL){
+            fprintf(stderr, "[ERROR] Cannot open serial output file %s\n", serial_option + 5);
+            exit(1);
+        }
+        serial_capture_init(&serial_backend, &serial_capture, serial_file);
+    }
+    else if(linked){
+        serial_link_init(&serial_backend, &link_ends[0], link_peer.ram);
+        serial_link_init(&link_peer_backend, &link_ends[1], gb.ram);
+        link_peer.serial.backend = &link_peer_backend; // not bound, its instance holds the state
+    }
+    else if(strncmp(serial_option, "socket-listen:", 14) == 0 || strncmp(serial_option, "socket:", 7) == 0){
+        bool listening = serial_option[6] == '-';
+        const char *path = strchr(serial_option, ':') + 1;
+        printf("[INFO] %s link cable socket %s\n", listening ? "Waiting on" : "Connecting to", path);
+        if(!(listening ? link_socket_listen(&link_socket, path, link_quantum)
+                       : link_socket_connect(&link_socket, path, link_quantum))){
+            fprintf(stderr, "[ERROR] Cannot open link cable socket %s\n", path);
+            exit(1);
+        }
+        serial_backend = link_socket.backend;
+    }
+    else{
+        PrintUsage();
+        exit(1);
+    }
+    serial.backend = &serial_backend;
 
-        if (sleep_duration_ns > 0) {
-            struct timespec sleep_spec = {0, sleep_duration_ns};
-            nanosleep(&sleep_spec, NULL);
+    if(shm_name != NULL){
+        if(!shm_export_open(&shm_export, shm_name)){
+            fprintf(stderr, "[ERROR] Cannot create shared memory segment %s\n", shm_name);
+            exit(1);
         }
+        printf("[INFO] Exporting frames to shared memory segment %s\n", shm_name);
     }
-    r_quit();
 
+    if(control_path != NULL){
+        if(!control_listen(&control, control_path, headless)){
+            fprintf(stderr, "[ERROR] Cannot create control socket %s\n", control_path);
+            exit(1);
+        }
+        printf("[INFO] Waiting for commands on %s\n", control_path);
+        fflush(stdout);
+    }
 
-    #ifdef DEBUG_TEST_LOG
-        EndLogger(&logger);
+    if(screenshot_path != NULL && (!headless || frames == 0)){
+        fprintf(stderr, "[ERROR] --screenshot needs --headless and --frames, in the window press F12\n");
+        exit(1);
+    }
+    pthread_atfork(NULL, NULL, forget_capture_in_child);
+    if((record_path != NULL || screenshot_path != NULL) && !capture_open(&capture, record_path)){
+        fprintf(stderr, "[ERROR] Cannot start the capture to %s\n", record_path != NULL ? record_path : "screenshots");
+        exit(1);
+    }
+
+    if(trace_path != NULL){
+        if(!trace_open(&tracer, trace_path, &trace_filter)){
+            fprintf(stderr, "[ERROR] Cannot create the trace file %s\n", trace_path);
+            exit(1);
+        }
+        emulator_set_tracer(&gb, &tracer);
+        printf("[INFO] Tracing to %s\n", trace_path);
+    }
+
+    if(headless){
+        run_headless(frames, screenshot_path);
+        if(explore_frames > 0) explore_all_inputs(explore_frames);
+    }
+    #ifndef HEADLESS
+    else{
+        run_windowed(pacing_policy, spin_ns, vsync_enabled, backend, frames);
+    }
+    #else
+        (void)pacing_policy; (void)spin_ns; // pacing only applies to the window
     #endif
+    link_socket_close(&link_socket);
+    shm_export_close(&shm_export);
+    control_close(&control);
+    capture_close(&capture); // writes what is still queued
+    if(tracer.active){
+        emulator_set_tracer(&gb, NULL);
+        trace_close(&tracer);
+        trace_print_stats(&tracer, stdout);
+    }
+    if(link_peer_cartridge.rom != cartridge.rom) cartridge_unload(&link_peer_cartridge);
+    cartridge_unload(&cartridge);
+
+    if(startup_stats) print_startup_stats(!headless);
+    if(frame_stats){
+        pacer_print_stats(&pacer, stdout);
+        if(emulation_time.count > 0){
+            fprintf(stdout, "[STATS] emulation time avg %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n",
+                    emulation_time.total_ns / (double)emulation_time.count / 1e6,
+                    histogram_percentile(&emulation_time, 50) / 1e6, histogram_percentile(&emulation_time, 99) / 1e6,
+                    emulation_time.max_ns / 1e6);
+        }
+        if(present_async) presenter_print_stats(&presenter, stdout);
+        if(vsync_enabled) vsync_print_stats(&vsync, stdout);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include <string.h>
+#include "redraw.h"
+
+#define HASH_INITIAL 2166136261u
+#define HASH_PRIME   16777619u
+
+static uint32_t cells[REDRAW_MAX_ROWS][REDRAW_MAX_COLUMNS]; // hashes of the frame being compared
+
+
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) { hash = (hash ^ p[i]) * HASH_PRIME; }
+  return hash;
+}
+
+
+mu_Rect redraw_intersect(mu_Rect a, mu_Rect b) {
+  int x1 = mu_max(a.x, b.x), y1 = mu_max(a.y, b.y);
+  int x2 = mu_min(a.x + a.w, b.x + b.w), y2 = mu_min(a.y + a.h, b.y + b.h);
+  if (x2 < x1) { x2 = x1; }
+  if (y2 < y1) { y2 = y1; }
+  return mu_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+
+bool redraw_overlaps(mu_Rect a, mu_Rect b) {
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+
+/* The next frame is drawn whole, e.g. the window was resized */
+void redraw_invalidate(RedrawState *state) {
+  state->everything = true;
+}
+
+
+/* Folds the hash of a command into the cells its rect covers */
+static void hash_cells(int columns, int rows, mu_Rect rect, uint32_t hash) {
+  if (rect.w <= 0 || rect.h <= 0) { return; }
+  int x0 = mu_clamp(rect.x / REDRAW_CELL_SIZE, 0, columns - 1);
+  int y0 = mu_clamp(rect.y / REDRAW_CELL_SIZE, 0, rows - 1);
+  int x1 = mu_clamp((rect.x + rect.w - 1) / REDRAW_CELL_SIZE, 0, columns - 1);
+  int y1 = mu_clamp((rect.y + rect.h - 1) / REDRAW_CELL_SIZE, 0, rows - 1);
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) { cells[y][x] = hash_bytes(cells[y][x], &hash, sizeof(hash)); }
+  }
+}
+
+
+/* Adds a dirty run of cells, it grows the run of the row above when they
+   span the same columns */
+static void add_rect(RedrawState *state, mu_Rect rect) {
+  for (int i = 0; i < state->rect_count; i++) {
+    mu_Rect *r = &state->rects[i];
+    if (r->x == rect.x && r->w == rect.w && r->y + r->h == rect.y) { r->h += rect.h; return; }
+  }
+  if (state->rect_count == REDRAW_MAX_RECTS) {
+    mu_Rect *r = &state->rects[0];
+    for (int i = 1; i < state->rect_count; i++) {
+      mu_Rect s = state->rects[i];
+      int x2 = mu_max(r->x + r->w, s.x + s.w), y2 = mu_max(r->y + r->h, s.y + s.h);
+      r->x = mu_min(r->x, s.x); r->y = mu_min(r->y, s.y);
+      r->w = x2 - r->x;         r->h = y2 - r->y;
+    }
+    state->rect_count = 1;
+  }
+  state->rects[state->rect_count++] = rect;
+}
+
+
+/* Hashes the commands of the frame just built by microui and returns how many
+   regions of the window changed since the previous call, in state->rects.
+   image_serial has to change when the content of the images changes. */
+int redraw_update(RedrawState *state, mu_Context *ctx, int width, int height, uint64_t image_serial) {
+  int columns = mu_clamp((width + REDRAW_CELL_SIZE - 1) / REDRAW_CELL_SIZE, 1, REDRAW_MAX_COLUMNS);
+  int rows    = mu_clamp((height + REDRAW_CELL_SIZE - 1) / REDRAW_CELL_SIZE, 1, REDRAW_MAX_ROWS);
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < columns; x++) { cells[y][x] = HASH_INITIAL; }
+  }
+
+  /* root containers in z order, a nested root container (e.g. a popup) is
+  ** skipped by its head jump and walked in its own turn */
+  for (int i = 0; i < ctx->root_list.idx; i++) {
+    mu_Container *cnt = ctx->root_list.items[i];
+    mu_Rect clip = mu_rect(0, 0, 0x1000000, 0x1000000);
+    mu_Command *cmd = (mu_Command*) ((char*) cnt->head + sizeof(mu_JumpCommand));
+
+    while (cmd != cnt->tail) {
+      mu_Rect rect;
+      uint32_t hash = HASH_INITIAL;
+      switch (cmd->type) {
+        case MU_COMMAND_JUMP: cmd = cmd->jump.dst; continue;
+        case MU_COMMAND_CLIP: clip = cmd->clip.rect; rect = mu_rect(0, 0, 0, 0); break;
+        case MU_COMMAND_RECT: hash = hash_bytes(hash, &cmd->rect, sizeof(mu_RectCommand)); rect = cmd->rect.rect; break;
+        case MU_COMMAND_ICON: hash = hash_bytes(hash, &cmd->icon, sizeof(mu_IconCommand)); rect = cmd->icon.rect; break;
+        case MU_COMMAND_IMAGE:
+          hash = hash_bytes(hash, &cmd->image, sizeof(mu_ImageCommand));
+          hash = hash_bytes(hash, &image_serial, sizeof(image_serial));
+          rect = cmd->image.rect;
+          break;
+        case MU_COMMAND_TEXT:
+          hash = hash_bytes(hash, &cmd->text, offsetof(mu_TextCommand, str));
+          hash = hash_bytes(hash, cmd->text.str, strlen(cmd->text.str));
+          rect = mu_rect(cmd->text.pos.x, cmd->text.pos.y,
+                         ctx->text_width(cmd->text.font, cmd->text.str, -1), ctx->text_height(cmd->text.font));
+          break;
+        default: rect = mu_rect(0, 0, 0, 0); break;
+      }
+      hash_cells(columns, rows, redraw_intersect(rect, clip), hash);
+      cmd = (mu_Command*) ((char*) cmd + cmd->base.size);
+    }
+  }
+
+  bool everything = state->everything || columns != state->columns || rows != state->rows;
+  state->rect_count = 0;
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < columns; x++) {
+      if (!everything && cells[y][x] == state->cells[y][x]) { continue; }
+      int start = x;
+      while (x + 1 < columns && (everything || cells[y][x + 1] != state->cells[y][x + 1])) { x++; }
+      /* the last row and column reach the window edge */
+      int x2 = x == columns - 1 ? mu_max(width, (x + 1) * REDRAW_CELL_SIZE) : (x + 1) * REDRAW_CELL_SIZE;
+      int y2 = y == rows - 1 ? mu_max(height, (y + 1) * REDRAW_CELL_SIZE) : (y + 1) * REDRAW_CELL_SIZE;
+      add_rect(state, mu_rect(start * REDRAW_CELL_SIZE, y * REDRAW_CELL_SIZE,
+                              x2 - start * REDRAW_CELL_SIZE, y2 - y * REDRAW_CELL_SIZE));
+    }
+  }
+
+  memcpy(state->cells, cells, sizeof(cells));
+  state->columns    = columns;
+  state->rows       = rows;
+  state->everything = false;
+  return state->rect_count;
+}
@@ -0,0 +1,30 @@
+#ifndef REDRAW_H
+#define REDRAW_H
+
+#include "microui.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REDRAW_CELL_SIZE  32  // pixels, the window is compared in cells of this size
+#define REDRAW_MAX_COLUMNS 64 // windows larger than the grid share the last cells
+#define REDRAW_MAX_ROWS    64
+#define REDRAW_MAX_RECTS   64 // more dirty regions than this are merged into one
+
+/* Regions of the window to draw again. Every command of the microui command
+   list, walked container by container in z order, is hashed into the cells it
+   covers; a cell whose hash differs from the previous frame is dirty. Images
+   are hashed with a serial that changes with their content. */
+typedef struct {
+  uint32_t cells[REDRAW_MAX_ROWS][REDRAW_MAX_COLUMNS];
+  int      columns, rows;
+  bool     everything;               // the previous content cannot be reused
+  mu_Rect  rects[REDRAW_MAX_RECTS];
+  int      rect_count;
+} RedrawState;
+
+void redraw_invalidate(RedrawState *state);
+int  redraw_update(RedrawState *state, mu_Context *ctx, int width, int height, uint64_t image_serial);
+bool redraw_overlaps(mu_Rect a, mu_Rect b);
+mu_Rect redraw_intersect(mu_Rect a, mu_Rect b);
+
+#endif
@@ -1,16 +1,64 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 #include "renderer.h"
 #include <SDL2/SDL_ttf.h>
 #include "SDL_FontCache.h"
 
 
 
-static SDL_Window   *window;
+#define TEXTURE_CACHE_SIZE 8
+#define ATLAS_COLUMNS      16   // the 128 ASCII cells are laid out 16 x 8
+#define TEXT_BATCH_GLYPHS  4096 // glyphs drawn by one SDL_RenderGeometry call at most
+
+/* Streaming texture of an image drawn with r_draw_image. There is one per 
+   owner (the pixel buffer drawn), it is created the first time the owner is 
+   drawn at that size and updated in place on the following frames, once
+   per frame however many times it is drawn. */
+typedef struct {
+  const void  *owner;
+  int          width, height;
+  SDL_Texture *texture;
+  uint64_t     uploaded; // presents + 1 when the pixels were copied during the current frame
+} CachedTexture;
+
+/* Cell of a glyph in the text atlas, w is also the advance of the pen */
+typedef struct {
+  SDL_Rect src;
+} AtlasGlyph;
+
+static SDL_Window   *window;              // NULL with the offscreen backend
+static SDL_Surface  *offscreen;           // drawn by the offscreen backend instead of a window
 static SDL_Renderer *renderer;
-static SDL_Texture  *texture;
-static FC_Font      *font;
+static FC_Font      *font;                // loaded by the first text drawn or measured
+static char          font_path_copy[256];
+static int           glyph_advance[128];  // widths of the ASCII glyphs, measured when the font loads
+static int           line_height;
+static RendererDrawStats draw_stats;
+static uint64_t     presents;            // frames presented, r_draw_image uploads an image once per frame
+
+/* The ASCII glyphs rendered once in white in a single texture. Text is queued
+   as textured quads colored per vertex and drawn with one SDL_RenderGeometry
+   call when something else is drawn, the clip changes or the frame ends. */
+static SDL_Texture  *atlas;
+static int           atlas_width, atlas_height;
+static AtlasGlyph    atlas_glyphs[128];
+static bool          text_batching = true;
+static SDL_Vertex    text_vertices[TEXT_BATCH_GLYPHS * 4];
+static int           text_indices[TEXT_BATCH_GLYPHS * 6];
+static int           text_glyphs;         // queued in text_vertices
+static RendererStartupStats startup_stats;
+static CachedTexture texture_cache[TEXTURE_CACHE_SIZE];
+static int           texture_cache_evict; // next entry replaced when the cache is full
+
+static SDL_Texture  *ui_target;           // kept across frames by r_begin_cached, only changed parts are drawn
+static int           ui_width, ui_height;
+static SDL_Texture  *frame_texture;       // written in place by r_get_frame_pixels
+static int           frame_width, frame_height;
+static void         *frame_pixels;        // texture memory while the frame is locked
+static int           frame_pitch;
 
 const char button_map[256] = {
   [ SDL_BUTTON_LEFT   & 0xff ] =  MU_MOUSE_LEFT,
@@ -31,81 +79,456 @@ const char key_map[256] = {
 
 static const char * codepoints_map[5] = { "\u1000", "\u2715", "\u2713", "\u25B6", "\u25BC"};
 
-void r_init(const char* window_title, int window_width, int window_height, const char *font_path) {
-  /* init SDL window */
-  SDL_Init(SDL_INIT_EVERYTHING);
-  window = SDL_CreateWindow(window_title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, window_width, window_height, SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
-  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+static const char *backend_names[] = { "accelerated", "software", "offscreen" };
+
+/* Creates the window and the renderer of the backend, returns false if the
+   backend does not work here */
+static bool create_renderer(const char *window_title, int window_width, int window_height, bool vsync, RendererBackend backend) {
+  if (backend == R_BACKEND_OFFSCREEN) {
+    offscreen = SDL_CreateRGBSurfaceWithFormat(0, window_width, window_height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (offscreen == NULL) { return false; }
+    renderer = SDL_CreateSoftwareRenderer(offscreen);
+    if (renderer == NULL) { SDL_FreeSurface(offscreen); offscreen = NULL; }
+    return renderer != NULL;
+  }
+
+  if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) { return false; }
+  window = SDL_CreateWindow(window_title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, window_width, window_height, SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
+  if (window == NULL) { return false; }
+
+  /* the software renderer has no vsync, it presents as soon as it is asked */
+  Uint32 flags = backend == R_BACKEND_SOFTWARE ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+  renderer = SDL_CreateRenderer(window, -1, flags);
+  if (renderer == NULL) { SDL_DestroyWindow(window); window = NULL; }
+  return renderer != NULL;
+}
+
+/* Returns the time since the first call in ms, for the startup stats */
+static double elapsed_ms(void) {
+  static Uint64 start;
+  Uint64 now = SDL_GetPerformanceCounter();
+  if (start == 0) { start = now; }
+  return (now - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* Renders the printable ASCII glyphs in the atlas, each one the way the font
+   cache renders it so both draw the same text at the same width. Characters
+   without a glyph take the width of a space. */
+static bool build_atlas(void) {
+  TTF_Font *ttf = TTF_OpenFont(font_path_copy, 12);
+  if (ttf == NULL) { return false; }
+
+  SDL_Surface *glyphs[128] = { NULL };
+  int cell_width = 1, cell_height = TTF_FontHeight(ttf);
+  SDL_Color white = { 255, 255, 255, 255 };
+  for (int c = ' '; c < 127; c++) {
+    char text[2] = { (char)c, '\0' };
+    glyphs[c] = TTF_RenderUTF8_Blended(ttf, text, white);
+    if (glyphs[c] != NULL && glyphs[c]->w > cell_width) { cell_width = glyphs[c]->w; }
+    if (glyphs[c] != NULL && glyphs[c]->h > cell_height) { cell_height = glyphs[c]->h; }
+  }
+  TTF_CloseFont(ttf);
+
+  atlas_width  = cell_width * ATLAS_COLUMNS;
+  atlas_height = cell_height * (128 / ATLAS_COLUMNS);
+  SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas_width, atlas_height, 32, SDL_PIXELFORMAT_ARGB8888);
+  for (int c = 0; c < 128; c++) {
+    atlas_glyphs[c].src = (SDL_Rect){ (c % ATLAS_COLUMNS) * cell_width, (c / ATLAS_COLUMNS) * cell_height, 0, 0 };
+    if (glyphs[c] == NULL) { continue; }
+    if (sheet != NULL) {
+      SDL_SetSurfaceBlendMode(glyphs[c], SDL_BLENDMODE_NONE); // the alpha is copied, not blended on the empty sheet
+      SDL_BlitSurface(glyphs[c], NULL, sheet, &atlas_glyphs[c].src);
+    }
+    atlas_glyphs[c].src.w = glyphs[c]->w;
+    atlas_glyphs[c].src.h = glyphs[c]->h;
+    SDL_FreeSurface(glyphs[c]);
+  }
+  if (sheet == NULL) { return false; }
+
+  atlas = SDL_CreateTextureFromSurface(renderer, sheet);
+  SDL_FreeSurface(sheet);
+  if (atlas == NULL) { return false; }
+  SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+
+  for (int c = 0; c < 128; c++) {
+    glyph_advance[c] = atlas_glyphs[c].src.w > 0 ? atlas_glyphs[c].src.w : atlas_glyphs[' '].src.w;
+  }
+  for (int i = 0; i < TEXT_BATCH_GLYPHS; i++) {
+    int quad[6] = { 0, 1, 2, 2, 3, 0 };
+    for (int j = 0; j < 6; j++) { text_indices[6 * i + j] = 4 * i + quad[j]; }
+  }
+  return true;
+}
+
+/* Draws the text queued since the last flush, before anything that has to 
+   appear on top of it or that changes the clip */
+static void flush_text(void) {
+  if (text_glyphs == 0) { return; }
+  SDL_RenderGeometry(renderer, atlas, text_vertices, text_glyphs * 4, text_indices, text_glyphs * 6);
+  draw_stats.draw_calls++;
+  text_glyphs = 0;
+}
+
+/* Copies a glyph of the font cache, each one is a SDL_RenderCopyEx call of
+   its own and counted as such */
+static FC_Rect count_glyph_copy(FC_Image *src, FC_Rect *srcrect, FC_Target *dest, float x, float y, float xscale, float yscale) {
+  draw_stats.draw_calls++;
+  return FC_DefaultRenderCallback(src, srcrect, dest, x, y, xscale, yscale);
+}
 
-  font = FC_CreateFont();  
-  if(FC_LoadFont(font, renderer, font_path, 12, FC_MakeColor(255,255,255,255), TTF_STYLE_NORMAL) == 0){
+/* Loads the font the first time it is needed: the emulator window never
+   draws text, only the debugger does */
+static FC_Font *get_font(void) {
+  if (font != NULL) { return font; }
+
+  double start = elapsed_ms();
+  font = FC_CreateFont();
+  if(FC_LoadFont(font, renderer, font_path_copy, 12, FC_MakeColor(255,255,255,255), TTF_STYLE_NORMAL) == 0){
+    fprintf(stderr, "[ERROR] Cannot load font %s\n", font_path_copy);
     exit(1);
   };
+  FC_SetRenderCallback(count_glyph_copy);
+
+  /* text is measured many times per frame by the microui layout, from these tables */
+  if (!build_atlas()) {
+    fprintf(stderr, "[INFO] Cannot build the text atlas, text is drawn glyph by glyph\n");
+    for (int c = 0; c < 128; c++) {
+      FC_GlyphData glyph;
+      glyph_advance[c] = (FC_GetGlyphData(font, &glyph, c) || FC_GetGlyphData(font, &glyph, ' ')) ? glyph.rect.w : 0;
+    }
+  }
+  line_height = FC_GetHeight(font, "text");
+
+  startup_stats.font_ms = elapsed_ms() - start;
+  startup_stats.font_loaded = true;
+  return font;
+}
+
+/* Starts the renderer with the backend passed. When it does not work (e.g. 
+   no GPU, or SDL_VIDEODRIVER=dummy) the next one in the order accelerated, 
+   software, offscreen is tried. Returns the backend in use. */
+RendererBackend r_init(const char* window_title, int window_width, int window_height, const char *font_path, bool vsync, RendererBackend backend) {
+  double start = elapsed_ms();
+  SDL_Init(SDL_INIT_EVENTS); // events work without a video driver, the window ones come with it
+  startup_stats.sdl_init_ms = elapsed_ms() - start;
+  start = elapsed_ms();
+  while (!create_renderer(window_title, window_width, window_height, vsync, backend)) {
+    if (backend == R_BACKEND_OFFSCREEN) {
+      fprintf(stderr, "[ERROR] Cannot create a renderer: %s\n", SDL_GetError());
+      exit(1);
+    }
+    fprintf(stderr, "[INFO] The %s renderer is not available (%s), trying %s\n", backend_names[backend], SDL_GetError(), backend_names[backend + 1]);
+    backend++;
+  }
+
+  startup_stats.window_ms = elapsed_ms() - start;
+
+  snprintf(font_path_copy, sizeof(font_path_copy), "%s", font_path);
+  return backend;
+}
+
+/* Returns how long the parts of the renderer startup took */
+void r_get_startup_stats(RendererStartupStats *stats) {
+  *stats = startup_stats;
+}
+
+/* Switches text between the atlas batches and the font cache, to compare them */
+void r_set_text_batching(bool enabled) {
+  flush_text();
+  text_batching = enabled;
+}
+
+/* Returns the draw calls and glyphs since the previous call */
+RendererDrawStats r_take_draw_stats(void) {
+  RendererDrawStats stats = draw_stats;
+  draw_stats = (RendererDrawStats){ 0 };
+  return stats;
+}
+
+/* Reads a backend name as written by r_backend_name, returns false if it is unknown */
+bool r_parse_backend(const char *name, RendererBackend *backend) {
+  for (int i = 0; i <= R_BACKEND_OFFSCREEN; i++) {
+    if (strcmp(name, backend_names[i]) == 0) { *backend = i; return true; }
+  }
+  return false;
+}
+
+const char *r_backend_name(RendererBackend backend) {
+  return backend_names[backend];
+}
 
-  #ifndef DEBUGGER_MODE
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, window_width, window_height);
-  #endif
+/* Returns what the offscreen backend drew up to the last r_present, NULL with
+   the other backends. pitch is set to the length of a row in pixels. */
+const uint32_t *r_get_offscreen_pixels(int *width, int *height, int *pitch) {
+  if (offscreen == NULL) { return NULL; }
+  *width  = offscreen->w;
+  *height = offscreen->h;
+  *pitch  = offscreen->pitch / (int)sizeof(uint32_t);
+  return offscreen->pixels;
 }
 
 void r_draw_rect(mu_Rect rect, mu_Color color) {
+  flush_text();
+  draw_stats.draw_calls += 2;
   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
   SDL_RenderDrawRect(renderer, (SDL_Rect *)&rect);
   SDL_RenderFillRect(renderer, (SDL_Rect *)&rect);
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 }
 
+/* Returns the cached texture of the owner with the size passed. A texture of
+   the same owner with another size (e.g. the window was resized) is replaced,
+   when the cache is full the entries are replaced in turn. */
+static CachedTexture *get_cached_texture(const void *owner, int width, int height) {
+  CachedTexture *entry = NULL;
+
+  for (int i = 0; i < TEXTURE_CACHE_SIZE && entry == NULL; i++) {
+    if (texture_cache[i].texture != NULL && texture_cache[i].owner == owner) { entry = &texture_cache[i]; }
+  }
+  if (entry != NULL && entry->width == width && entry->height == height) { return entry; }
+
+  for (int i = 0; i < TEXTURE_CACHE_SIZE && entry == NULL; i++) {
+    if (texture_cache[i].texture == NULL) { entry = &texture_cache[i]; }
+  }
+  if (entry == NULL) {
+    entry = &texture_cache[texture_cache_evict];
+    texture_cache_evict = (texture_cache_evict + 1) % TEXTURE_CACHE_SIZE;
+  }
+
+  if (entry->texture != NULL) { SDL_DestroyTexture(entry->texture); }
+  entry->owner   = owner;
+  entry->width   = width;
+  entry->height  = height;
+  entry->uploaded = 0;
+  entry->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+  return entry->texture != NULL ? entry : NULL;
+}
+
+
+/* Draws the image scaled to the rect. Its pixels are uploaded the first time
+   it is drawn in a frame, the other draws of the frame (one per region that
+   is redrawn) reuse the texture. */
 void r_draw_image(mu_Rect dst_rect, int img_width, int img_height, const uint32_t *framebuffer) {
-  
-  #ifdef DEBUGGER_MODE
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, img_width, img_height);
-  SDL_UpdateTexture(texture, NULL, framebuffer, img_width * sizeof(uint32_t));  // Update the texture with the new pixel data
-  SDL_RenderCopy(renderer, texture, NULL, (SDL_Rect *)&dst_rect); // Copy the texture to the renderer
-  //SDL_DestroyTexture(texture);
-  #else
-  SDL_UpdateTexture(texture, NULL, framebuffer, img_width * sizeof(uint32_t));  // Update the texture with the new pixel data
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  #endif
+  CachedTexture *entry = get_cached_texture(framebuffer, img_width, img_height);
+  if (entry == NULL) { return; }
+  flush_text();
+
+  if (entry->uploaded != presents + 1) {
+    /* the texture memory is written directly, its rows can be longer than the image ones */
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(entry->texture, NULL, &pixels, &pitch) != 0) { return; }
+    for (int y = 0; y < img_height; y++) {
+      memcpy((uint8_t *)pixels + y * pitch, framebuffer + y * img_width, img_width * sizeof(uint32_t));
+    }
+    SDL_UnlockTexture(entry->texture);
+    entry->uploaded = presents + 1;
+  }
+
+  SDL_RenderCopy(renderer, entry->texture, NULL, (SDL_Rect *)&dst_rect);
+  draw_stats.draw_calls++;
+}
+
+/* Starts a frame written in place: the frame texture is locked until 
+   r_end_frame. The memory is write only, everything has to be written again
+   before the frame ends. Returns false if the texture cannot be locked. */
+bool r_begin_frame(int width, int height) {
+  if (frame_texture == NULL || frame_width != width || frame_height != height) {
+    if (frame_texture != NULL) { SDL_DestroyTexture(frame_texture); }
+    frame_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    frame_width   = width;
+    frame_height  = height;
+    if (frame_texture == NULL) { return false; }
+  }
+
+  if (SDL_LockTexture(frame_texture, NULL, &frame_pixels, &frame_pitch) != 0) {
+    frame_pixels = NULL;
+    return false;
+  }
+  return true;
+}
+
+
+/* Returns the texture memory of the frame begun, NULL outside of a frame. 
+   pitch is set to the length of a row in pixels. */
+uint32_t *r_get_frame_pixels(int *pitch) {
+  *pitch = frame_pitch / (int)sizeof(uint32_t);
+  return frame_pixels;
+}
+
+
+/* Ends the frame, the texture is uploaded when it is unlocked */
+void r_end_frame(void) {
+  if (frame_pixels == NULL) { return; }
+  SDL_UnlockTexture(frame_texture);
+  frame_pixels = NULL;
+}
+
+
+/* Draws the last frame ended, scaled to the rect or to the whole window when
+   it is NULL, so it follows the window when it is resized */
+void r_draw_frame(const mu_Rect *dst_rect) {
+  if (frame_texture == NULL) { return; }
+  flush_text();
+  SDL_RenderCopy(renderer, frame_texture, NULL, (const SDL_Rect *)dst_rect);
+  draw_stats.draw_calls++;
+}
+
+/* Sends the drawing to a texture of the window size that keeps its content
+   across frames, so only the parts that changed have to be drawn again. 
+   invalidated is set when its content is undefined (first use, resize). 
+   Returns false when the renderer cannot draw to textures, drawing then goes
+   to the window and the whole frame has to be drawn. */
+bool r_begin_cached(int *width, int *height, bool *invalidated) {
+  flush_text();
+  SDL_GetRendererOutputSize(renderer, width, height);
+  *invalidated = true;
+  if (!SDL_RenderTargetSupported(renderer)) { return false; }
+
+  if (ui_target == NULL || ui_width != *width || ui_height != *height) {
+    if (ui_target != NULL) { SDL_DestroyTexture(ui_target); }
+    ui_target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, *width, *height);
+    ui_width  = *width;
+    ui_height = *height;
+    if (ui_target == NULL) { return false; }
+  }
+  else {
+    *invalidated = false;
+  }
+  return SDL_SetRenderTarget(renderer, ui_target) == 0;
+}
+
+
+/* Goes back to drawing to the window and copies the cached texture on it */
+void r_end_cached(void) {
+  flush_text();
+  SDL_SetRenderTarget(renderer, NULL);
+  SDL_RenderSetClipRect(renderer, NULL);
+  SDL_RenderCopy(renderer, ui_target, NULL, NULL);
+  draw_stats.draw_calls++;
 }
 
+
+/* Queues the text in the batch when it is ASCII, otherwise draws it through
+   the font cache, one copy per glyph */
 void r_draw_text(const char *text, mu_Vec2 pos, mu_Color color) {
-  FC_DrawColor(font, renderer, pos.x, pos.y, *(SDL_Color*)&color, text); 
+  FC_Font *f = get_font();
+  bool ascii = atlas != NULL && text_batching;
+  for (const char *c = text; ascii && *c != '\0'; c++) { ascii = (unsigned char)*c < 128; }
+  draw_stats.glyphs += strlen(text);
+
+  if (!ascii) {
+    flush_text();
+    FC_DrawColor(f, renderer, pos.x, pos.y, *(SDL_Color*)&color, "%s", text); // counted by count_glyph_copy
+    return;
+  }
+
+  SDL_Color vertex_color = { color.r, color.g, color.b, color.a };
+  float x = pos.x;
+  for (const char *c = text; *c != '\0'; c++) {
+    const SDL_Rect *src = &atlas_glyphs[(unsigned char)*c].src;
+    if (src->w > 0) {
+      if (text_glyphs == TEXT_BATCH_GLYPHS) { flush_text(); }
+      float u0 = (float)src->x / atlas_width,  u1 = (float)(src->x + src->w) / atlas_width;
+      float v0 = (float)src->y / atlas_height, v1 = (float)(src->y + src->h) / atlas_height;
+      float y0 = pos.y, x1 = x + src->w, y1 = pos.y + src->h;
+      SDL_Vertex *v = &text_vertices[text_glyphs * 4];
+      v[0] = (SDL_Vertex){ { x,  y0 }, vertex_color, { u0, v0 } };
+      v[1] = (SDL_Vertex){ { x1, y0 }, vertex_color, { u1, v0 } };
+      v[2] = (SDL_Vertex){ { x1, y1 }, vertex_color, { u1, v1 } };
+      v[3] = (SDL_Vertex){ { x,  y1 }, vertex_color, { u0, v1 } };
+      text_glyphs++;
+    }
+    x += glyph_advance[(unsigned char)*c];
+  }
 }
 
 
 void r_draw_icon(int id, mu_Rect rect, mu_Color color) {
-  FC_DrawColor(font, renderer, rect.x + 2, rect.y + 2, *(SDL_Color*)&color, "%s", codepoints_map[id]);
+  flush_text();
+  FC_DrawColor(get_font(), renderer, rect.x + 2, rect.y + 2, *(SDL_Color*)&color, "%s", codepoints_map[id]);
 }
 
 
+/* Returns the width of the first len bytes of text (all of it when len is 
+   -1), the widest line when there are more. ASCII comes from the advance
+   table, other characters are looked up in the font cache. */
 int r_get_text_width(const char *text, int len) {
-  return FC_GetWidth(font, text);
+  FC_Font *f = get_font();
+  if (len < 0) { len = strlen(text); }
+
+  int width = 0, widest = 0;
+  const char *end = text + len;
+  for (const char *c = text; c < end && *c != '\0'; c++) {
+    unsigned char byte = *c;
+    if (byte == '\n') {
+      if (width > widest) { widest = width; }
+      width = 0;
+    }
+    else if (byte < 128) {
+      width += glyph_advance[byte];
+    }
+    else {
+      FC_GlyphData glyph;
+      Uint32 codepoint = FC_GetCodepointFromUTF8(&c, 1); // leaves c on the last byte of the character
+      if (FC_GetGlyphData(f, &glyph, codepoint) || FC_GetGlyphData(f, &glyph, ' ')) { width += glyph.rect.w; }
+    }
+  }
+  return width > widest ? width : widest;
 }
 
 
 int r_get_text_height(void) {
-  return FC_GetHeight(font, "text");
+  get_font();
+  return line_height;
+}
+
+
+/* Returns the refresh rate of the display showing the window, 0 if unknown */
+int r_get_refresh_rate(void) {
+  SDL_DisplayMode mode;
+  if (window == NULL) { return 0; }
+  if (SDL_GetWindowDisplayMode(window, &mode) != 0) { return 0; }
+  return mode.refresh_rate;
 }
 
 
 void r_set_clip_rect(mu_Rect rect) {
+  flush_text();
   SDL_RenderSetClipRect(renderer, (SDL_Rect *)&rect);
 }
 
 
 void r_clear(mu_Color color) {
+  text_glyphs = 0; // covered by the clear anyway
   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
   SDL_RenderClear(renderer);
 }
 
 
 void r_present(void) {
+  flush_text();
   SDL_RenderPresent(renderer);
+  presents++;
 }
 
 void r_quit(void){
-  FC_FreeFont(font);
-  SDL_DestroyTexture(texture);
+  if (font != NULL) { FC_FreeFont(font); }
+  if (atlas != NULL) { SDL_DestroyTexture(atlas); }
+  font  = NULL;
+  atlas = NULL;
+  for (int i = 0; i < TEXTURE_CACHE_SIZE; i++) {
+    if (texture_cache[i].texture != NULL) { SDL_DestroyTexture(texture_cache[i].texture); }
+    texture_cache[i].texture = NULL;
+  }
+  if (frame_texture != NULL) { SDL_DestroyTexture(frame_texture); }
+  if (ui_target != NULL) { SDL_DestroyTexture(ui_target); }
+  frame_texture = NULL;
+  ui_target     = NULL;
   SDL_DestroyRenderer(renderer);
-  SDL_DestroyWindow(window);
+  if (window != NULL) { SDL_DestroyWindow(window); }
+  if (offscreen != NULL) { SDL_FreeSurface(offscreen); }
+  window    = NULL;
+  offscreen = NULL;
   SDL_Quit();
 }
\ No newline at end of file
@@ -3,17 +3,52 @@
 
 #include "microui.h"
 #include <stdint.h>
+#include <stdbool.h>
+
+/* Where the renderer draws, chosen when it starts */
+typedef enum {
+  R_BACKEND_ACCELERATED, // window drawn by the GPU driver SDL picks
+  R_BACKEND_SOFTWARE,    // window drawn by the CPU, works with any video driver including dummy
+  R_BACKEND_OFFSCREEN    // no window, drawn by the CPU in a surface in memory
+} RendererBackend;
+
+/* Time spent starting the renderer, in ms */
+typedef struct {
+  double sdl_init_ms; // SDL with the events subsystem only
+  double window_ms;   // video subsystem, window and renderer
+  double font_ms;     // font parsed on first use
+  bool   font_loaded;
+} RendererStartupStats;
+
+/* Render calls issued, a string through the font cache costs one per glyph */
+typedef struct {
+  uint64_t draw_calls;
+  uint64_t glyphs;
+} RendererDrawStats;
 
 extern const char button_map[256];
 extern const char key_map[256];
 
-void r_init(const char* window_title, int window_width, int window_height, const char *font_path);
+RendererBackend r_init(const char* window_title, int window_width, int window_height, const char *font_path, bool vsync, RendererBackend backend);
+bool r_parse_backend(const char *name, RendererBackend *backend);
+const char *r_backend_name(RendererBackend backend);
+void r_get_startup_stats(RendererStartupStats *stats);
+void r_set_text_batching(bool enabled);
+RendererDrawStats r_take_draw_stats(void);
+const uint32_t *r_get_offscreen_pixels(int *width, int *height, int *pitch);
 void r_draw_rect(mu_Rect rect, mu_Color color);
 void r_draw_image(mu_Rect dst_rect, int img_width, int img_height, const uint32_t *framebuffer);
+bool r_begin_frame(int width, int height);
+uint32_t *r_get_frame_pixels(int *pitch);
+void r_end_frame(void);
+void r_draw_frame(const mu_Rect *dst_rect);
+bool r_begin_cached(int *width, int *height, bool *invalidated);
+void r_end_cached(void);
 void r_draw_text(const char *text, mu_Vec2 pos, mu_Color color);
 void r_draw_icon(int id, mu_Rect rect, mu_Color color);
  int r_get_text_width(const char *text, int len);
  int r_get_text_height(void);
+ int r_get_refresh_rate(void);
 void r_set_clip_rect(mu_Rect rect);
 void r_clear(mu_Color color);
 void r_present(void);
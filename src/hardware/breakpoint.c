@@ -0,0 +1,245 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "breakpoint.h"
+#include "memory.h"
+
+static const char *const register_names[] = { "A", "F", "B", "C", "D", "E", "H", "L", "AF", "BC", "DE", "HL", "SP", "PC" };
+
+
+void breakpoints_init(BREAKPOINTS *bps){
+    memset(bps, 0, sizeof(BREAKPOINTS));
+    bps->hit = -1;
+}
+
+
+
+static void skip_spaces(const char **p){
+    while(**p == ' ') (*p)++;
+}
+
+/* Compiles an operand: a register, a byte of memory as [ADDR] or a number,
+   all in hex. A number that reads as a register needs a leading 0. */
+static bool compile_operand(const char **p, BREAKPOINT_INSN *insn){
+    skip_spaces(p);
+    if(**p == '['){
+        char *end;
+        unsigned long addr = strtoul(*p + 1, &end, 16);
+        if(end == *p + 1 || *end != ']' || addr > 0xFFFF) return false;
+        *insn = (BREAKPOINT_INSN){ BP_MEM, addr };
+        *p = end + 1;
+        return true;
+    }
+
+    size_t len = 0;
+    while(isalnum((unsigned char)(*p)[len])) len++;
+    for(int reg = BP_REG_PC; reg >= 0; reg--){
+        const char *name = register_names[reg];
+        if(len == strlen(name) && strncasecmp(*p, name, len) == 0){
+            *insn = (BREAKPOINT_INSN){ BP_REG, reg };
+            *p += len;
+            return true;
+        }
+    }
+
+    char *end;
+    unsigned long value = strtoul(*p, &end, 16);
+    if(end == *p || value > 0xFFFF) return false;
+    *insn = (BREAKPOINT_INSN){ BP_IMM, value };
+    *p = end;
+    return true;
+}
+
+static bool compile_compare(const char **p, BREAKPOINT_INSN *insn){
+    static const struct { const char *text; BREAKPOINT_OP op; } compares[] = {
+        { "==", BP_EQ }, { "!=", BP_NE }, { "<=", BP_LE }, { ">=", BP_GE }, { "<", BP_LT }, { ">", BP_GT }
+    };
+    skip_spaces(p);
+    for(size_t i = 0; i < sizeof(compares) / sizeof(compares[0]); i++){
+        size_t len = strlen(compares[i].text);
+        if(strncmp(*p, compares[i].text, len) == 0){
+            insn->op = compares[i].op;
+            insn->arg = 0;
+            *p += len;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+/* This function compiles a condition, comparisons joined by &&, e.g.
+   "A == 3C && [FF44] >= 90", into at most max instructions ending with
+   BP_END. An empty condition is always true. Returns false if the source is
+   not valid or does not fit. */
+bool breakpoint_compile(const char *source, BREAKPOINT_INSN *code, int max){
+    const char *p = source;
+    int n = 0, terms = 0;
+    skip_spaces(&p);
+    while(*p != '\0'){
+        if(terms > 0){
+            if(strncmp(p, "&&", 2) != 0) return false;
+            p += 2;
+        }
+        if(n + 4 + (terms > 0) >= max) return false; // two operands, the compare, the and and the end
+        if(!compile_operand(&p, &code[n]) || !compile_compare(&p, &code[n + 2]) || !compile_operand(&p, &code[n + 1])) return false;
+        n += 3;
+        if(terms++ > 0) code[n++] = (BREAKPOINT_INSN){ BP_AND, 0 };
+        skip_spaces(&p);
+    }
+    code[n] = (BREAKPOINT_INSN){ BP_END, 0 };
+    return true;
+}
+
+
+
+static uint16_t read_register(const CPU *cpu, int reg){
+    switch(reg){
+        case BP_REG_A:  return cpu->AF >> 8;
+        case BP_REG_F:  return cpu->AF & 0xFF;
+        case BP_REG_B:  return cpu->BC >> 8;
+        case BP_REG_C:  return cpu->BC & 0xFF;
+        case BP_REG_D:  return cpu->DE >> 8;
+        case BP_REG_E:  return cpu->DE & 0xFF;
+        case BP_REG_H:  return cpu->HL >> 8;
+        case BP_REG_L:  return cpu->HL & 0xFF;
+        case BP_REG_AF: return cpu->AF;
+        case BP_REG_BC: return cpu->BC;
+        case BP_REG_DE: return cpu->DE;
+        case BP_REG_HL: return cpu->HL;
+        case BP_REG_SP: return cpu->SP;
+        default:        return cpu->PC;
+    }
+}
+
+/* This function evaluates a compiled condition on the bound emulator. Memory
+   is read as it is stored, without the access restrictions of the CPU. */
+bool breakpoint_eval(const BREAKPOINT_INSN *code, const CPU *cpu){
+    uint16_t stack[BREAKPOINT_STACK_MAX];
+    int top = 0;
+    for(; code->op != BP_END; code++){
+        uint16_t a, b;
+        switch(code->op){
+            case BP_REG: stack[top++] = read_register(cpu, code->arg); continue;
+            case BP_MEM: stack[top++] = code->arg < ROM_SIZE ? rom[code->arg] : MEM(code->arg); continue;
+            case BP_IMM: stack[top++] = code->arg; continue;
+        }
+        b = stack[--top];
+        a = stack[--top];
+        switch(code->op){
+            case BP_EQ:  stack[top++] = a == b; break;
+            case BP_NE:  stack[top++] = a != b; break;
+            case BP_LT:  stack[top++] = a <  b; break;
+            case BP_LE:  stack[top++] = a <= b; break;
+            case BP_GT:  stack[top++] = a >  b; break;
+            case BP_GE:  stack[top++] = a >= b; break;
+            case BP_AND: stack[top++] = a && b; break;
+        }
+    }
+    return top == 0 || stack[top - 1] != 0;
+}
+
+
+
+/* This function adds a breakpoint at addr that stops the emulation when the
+   condition holds (NULL or empty for always). Returns false if the condition
+   is not valid or there is no room. */
+bool breakpoint_add(BREAKPOINTS *bps, uint16_t addr, const char *condition, bool temporary){
+    if(bps->count == BREAKPOINT_MAX) return false;
+    BREAKPOINT *bp = &bps->list[bps->count];
+    memset(bp, 0, sizeof(BREAKPOINT));
+    if(condition == NULL) condition = "";
+    if(!breakpoint_compile(condition, bp->code, BREAKPOINT_CODE_MAX)) return false;
+    snprintf(bp->condition, sizeof(bp->condition), "%s", condition);
+    bp->addr = addr;
+    bp->temporary = temporary;
+    bps->pages[addr >> 8]++;
+    bps->count++;
+    return true;
+}
+
+
+
+void breakpoint_remove(BREAKPOINTS *bps, int index){
+    if(index < 0 || index >= bps->count) return;
+    bps->pages[bps->list[index].addr >> 8]--;
+    memmove(&bps->list[index], &bps->list[index + 1], (bps->count - index - 1) * sizeof(BREAKPOINT));
+    bps->count--;
+    if(bps->hit == index) bps->hit = -1;
+    else if(bps->hit > index) bps->hit--;
+}
+
+
+
+/* This function stops the emulation, step over breakpoints that were not
+   reached are dropped */
+static void stop(BREAKPOINTS *bps, int hit){
+    bps->stopped  = true;
+    bps->stepping = false;
+    bps->hit = hit;
+    for(int i = bps->count - 1; i >= 0; i--){
+        if(bps->list[i].temporary) breakpoint_remove(bps, i);
+    }
+}
+
+/* This function is called by the run loop before the instruction at PC when
+   the emulation is stepping or PC is on a page with breakpoints. Returns true
+   if the emulation has to stop there. */
+bool breakpoint_stop(BREAKPOINTS *bps, const CPU *cpu){
+    if(bps->stepping){
+        stop(bps, -1);
+        return true;
+    }
+    for(int i = 0; i < bps->count; i++){
+        BREAKPOINT *bp = &bps->list[i];
+        if(bp->addr != cpu->PC || !breakpoint_eval(bp->code, cpu)) continue;
+        bp->hits++;
+        stop(bps, bp->temporary ? -1 : i);
+        return true;
+    }
+    return false;
+}
+
+
+
+/* Resumes the emulation, the instruction where it stopped runs first */
+void breakpoints_continue(BREAKPOINTS *bps){
+    bps->stopped = false;
+    bps->resume = true;
+}
+
+/* Runs one instruction, or services one interrupt, then stops again */
+void breakpoints_step(BREAKPOINTS *bps){
+    bps->stepping = true;
+    breakpoints_continue(bps);
+}
+
+/* Like a step, but a call or a restart runs until it returns: a temporary
+   breakpoint after it that only holds back at the same stack depth */
+void breakpoints_step_over(BREAKPOINTS *bps, const CPU *cpu){
+    uint8_t opcode = cpu->PC < ROM_SIZE ? rom[cpu->PC] : MEM(cpu->PC);
+    int length = 0;
+    if(opcode == 0xCD || (opcode & 0xE7) == 0xC4) length = 3;  // CALL, CALL cc
+    else if((opcode & 0xC7) == 0xC7) length = 1;                // RST
+    if(length == 0 || cpu->halted){
+        breakpoints_step(bps);
+        return;
+    }
+
+    char condition[16];
+    snprintf(condition, sizeof(condition), "SP >= %04X", cpu->SP);
+    if(!breakpoint_add(bps, cpu->PC + length, condition, true)){
+        breakpoints_step(bps); // no room, a plain step
+        return;
+    }
+    breakpoints_continue(bps);
+}
+
+/* Stops the emulation where it is, between two frames when called by the UI */
+void breakpoints_pause(BREAKPOINTS *bps){
+    bps->stopped = true;
+    bps->hit = -1;
+}
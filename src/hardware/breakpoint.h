@@ -0,0 +1,72 @@
+#ifndef BREAKPOINT_H
+#define BREAKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cpu.h"
+
+#define BREAKPOINT_MAX        32
+#define BREAKPOINT_CODE_MAX   24 // instructions of a compiled condition
+#define BREAKPOINT_STACK_MAX  8
+#define BREAKPOINT_SOURCE_MAX 64
+
+/* Instructions of a condition, evaluated on a stack of 16 bit values */
+typedef enum BREAKPOINT_OP {
+    BP_END,
+    BP_REG, // pushes register arg (BP_REG_*)
+    BP_MEM, // pushes the byte at address arg
+    BP_IMM, // pushes arg
+    BP_EQ, BP_NE, BP_LT, BP_LE, BP_GT, BP_GE, // pop b, pop a, push a op b
+    BP_AND
+} BREAKPOINT_OP;
+
+typedef enum BREAKPOINT_REG {
+    BP_REG_A, BP_REG_F, BP_REG_B, BP_REG_C, BP_REG_D, BP_REG_E, BP_REG_H, BP_REG_L,
+    BP_REG_AF, BP_REG_BC, BP_REG_DE, BP_REG_HL, BP_REG_SP, BP_REG_PC
+} BREAKPOINT_REG;
+
+typedef struct BREAKPOINT_INSN {
+    uint8_t op;
+    uint16_t arg;
+} BREAKPOINT_INSN;
+
+typedef struct BREAKPOINT {
+    uint16_t addr;
+    bool temporary; // set by step over, removed when the emulation stops
+    BREAKPOINT_INSN code[BREAKPOINT_CODE_MAX]; // the condition, BP_END first when there is none
+    char condition[BREAKPOINT_SOURCE_MAX];
+    uint64_t hits;
+} BREAKPOINT;
+
+/* Breakpoints of an emulator. Each page of 256 bytes counts the breakpoints
+   on it, the run loop only looks at the list when PC is on a page that has
+   some, and it only runs that loop while something is armed. */
+typedef struct BREAKPOINTS {
+    uint8_t pages[256];
+    int count;
+    BREAKPOINT list[BREAKPOINT_MAX];
+
+    bool stepping; // stop before the next instruction
+    bool resume;   // the next instruction runs without checks, it is the one where the emulation stopped
+    bool stopped;  // set by the run loop, cleared by whoever resumes it
+    int hit;       // breakpoint that stopped the emulation, -1 for a step or a pause
+} BREAKPOINTS;
+
+void breakpoints_init(BREAKPOINTS *bps);
+bool breakpoint_add(BREAKPOINTS *bps, uint16_t addr, const char *condition, bool temporary);
+void breakpoint_remove(BREAKPOINTS *bps, int index);
+bool breakpoint_compile(const char *source, BREAKPOINT_INSN *code, int max);
+bool breakpoint_eval(const BREAKPOINT_INSN *code, const CPU *cpu);
+bool breakpoint_stop(BREAKPOINTS *bps, const CPU *cpu);
+void breakpoints_continue(BREAKPOINTS *bps);
+void breakpoints_step(BREAKPOINTS *bps);
+void breakpoints_step_over(BREAKPOINTS *bps, const CPU *cpu);
+void breakpoints_pause(BREAKPOINTS *bps);
+
+/* Whether the run loop has to check before each instruction */
+static inline bool breakpoints_armed(const BREAKPOINTS *bps){
+    return bps->count > 0 || bps->stepping || bps->resume;
+}
+
+#endif
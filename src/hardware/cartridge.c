@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cartridge.h"
+
+
+/* This function maps the ROM file read only. A file smaller than ROM_SIZE
+   is copied into a private buffer padded with 0xFF (what an open bus reads)
+   because the pages of a mapping past the end of the file cannot be read.
+   Returns false if the file cannot be opened. */
+bool cartridge_load(CARTRIDGE *cart, const char *path){
+    memset(cart, 0, sizeof(CARTRIDGE));
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        return false;
+    }
+    cart->size = st.st_size;
+
+    if(cart->size >= ROM_SIZE){
+        void *rom = mmap(NULL, cart->size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps the file referenced
+        if(rom == MAP_FAILED) return false;
+
+        cart->rom    = rom;
+        cart->length = cart->size;
+        cart->mapped = true;
+        return true;
+    }
+
+    uint8_t *rom = malloc(ROM_SIZE);
+    if(rom == NULL){
+        close(fd);
+        return false;
+    }
+    memset(rom, 0xFF, ROM_SIZE);
+    ssize_t bytes = read(fd, rom, cart->size);
+    close(fd);
+    if(bytes != (ssize_t)cart->size){
+        free(rom);
+        return false;
+    }
+
+    cart->rom    = rom;
+    cart->length = ROM_SIZE;
+    cart->owned  = true;
+    return true;
+}
+
+
+
+/* This function wraps a ROM that is already in memory, the buffer must have
+   at least ROM_SIZE bytes and must outlive the emulators using it */
+void cartridge_from_buffer(CARTRIDGE *cart, const uint8_t *rom, size_t size){
+    cart->rom    = rom;
+    cart->size   = size;
+    cart->length = size;
+    cart->mapped = false;
+    cart->owned  = false;
+}
+
+
+
+void cartridge_unload(CARTRIDGE *cart){
+    if(cart->rom == NULL) return;
+
+    if(cart->mapped) munmap((void *)cart->rom, cart->length);
+    else if(cart->owned) free((void *)cart->rom);
+    cart->rom = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ROM_SIZE 0x8000 // 0x0000-0x7FFF, the part of the cartridge visible without a bank controller
+
+/* A cartridge ROM. It is read only so one cartridge is shared by all the 
+   emulators running the same game: the file is mapped once and the pages come
+   from the page cache, they are shared with the other processes mapping it too. 
+   rom always has at least ROM_SIZE readable bytes. */
+typedef struct CARTRIDGE {
+    const uint8_t *rom;
+    size_t size;   // bytes of the file
+    size_t length; // bytes of the mapping or of the allocation
+    bool mapped;   // rom is a mapping of the file
+    bool owned;    // rom is a padded copy allocated by cartridge_load
+} CARTRIDGE;
+
+bool cartridge_load(CARTRIDGE *cart, const char *path);
+void cartridge_from_buffer(CARTRIDGE *cart, const uint8_t *rom, size_t size);
+void cartridge_unload(CARTRIDGE *cart);
+
+#endif
@@ -4,6 +4,9 @@
 #include "memory.h"
 #include "timer.h"
 
+Instruction instruction_table[256];
+Instruction cb_instruction_table[256];
+
 /* ---- FUNCTION POINTERS FOR OPCODES SECTION ---- */
 int UNKNOWN(CPU *cpu){
     uint8_t opcode = ReadMem(cpu->PC - 1);
@@ -1236,8 +1239,8 @@ int NOP(CPU *cpu){ return 4; }
 
 /* This performs the HALT instruction */
 int HALT(CPU *cpu){ 
-    uint8_t IF = memory[IF_REG];
-    uint8_t IE = memory[IE_REG];
+    uint8_t IF = MEM(IF_REG);
+    uint8_t IE = MEM(IE_REG);
     // HALT bug
    if(!cpu->IME && (IE & IF) != 0){
         cpu->halt_bug = true;
@@ -1253,10 +1256,10 @@ int STOP(CPU *cpu){
     FetchByte(cpu);
 
     // resets DIV register 
-    memory[DIV_REG] = 0; 
+    MEM(DIV_REG) = 0; 
     timer.div_cycle_counter = 0;
 
-    uint8_t TAC = memory[TAC_REG];
+    uint8_t TAC = MEM(TAC_REG);
 
     if((TAC & 0x0040) != 0){ // Enable = 1 increment TIMA
 
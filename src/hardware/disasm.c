@@ -0,0 +1,217 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "disasm.h"
+#include "memory.h"
+
+/* Mnemonics laid out like instruction_table in cpu.c, operands are written
+   lowercase: d8/d16 immediates, a8/a16 addresses, r8 the target of a
+   relative jump and e8 a signed offset. The opcodes the SM83 does not have
+   are empty, the emulator runs them as NOP. */
+static const char *const mnemonics[256] = {
+    /* 00 */ "NOP", "LD BC,d16", "LD (BC),A", "INC BC", "INC B", "DEC B", "LD B,d8", "RLCA",
+    /* 08 */ "LD (a16),SP", "ADD HL,BC", "LD A,(BC)", "DEC BC", "INC C", "DEC C", "LD C,d8", "RRCA",
+    /* 10 */ "STOP", "LD DE,d16", "LD (DE),A", "INC DE", "INC D", "DEC D", "LD D,d8", "RLA",
+    /* 18 */ "JR r8", "ADD HL,DE", "LD A,(DE)", "DEC DE", "INC E", "DEC E", "LD E,d8", "RRA",
+    /* 20 */ "JR NZ,r8", "LD HL,d16", "LD (HL+),A", "INC HL", "INC H", "DEC H", "LD H,d8", "DAA",
+    /* 28 */ "JR Z,r8", "ADD HL,HL", "LD A,(HL+)", "DEC HL", "INC L", "DEC L", "LD L,d8", "CPL",
+    /* 30 */ "JR NC,r8", "LD SP,d16", "LD (HL-),A", "INC SP", "INC (HL)", "DEC (HL)", "LD (HL),d8", "SCF",
+    /* 38 */ "JR C,r8", "ADD HL,SP", "LD A,(HL-)", "DEC SP", "INC A", "DEC A", "LD A,d8", "CCF",
+    /* 40 */ "LD B,B", "LD B,C", "LD B,D", "LD B,E", "LD B,H", "LD B,L", "LD B,(HL)", "LD B,A",
+    /* 48 */ "LD C,B", "LD C,C", "LD C,D", "LD C,E", "LD C,H", "LD C,L", "LD C,(HL)", "LD C,A",
+    /* 50 */ "LD D,B", "LD D,C", "LD D,D", "LD D,E", "LD D,H", "LD D,L", "LD D,(HL)", "LD D,A",
+    /* 58 */ "LD E,B", "LD E,C", "LD E,D", "LD E,E", "LD E,H", "LD E,L", "LD E,(HL)", "LD E,A",
+    /* 60 */ "LD H,B", "LD H,C", "LD H,D", "LD H,E", "LD H,H", "LD H,L", "LD H,(HL)", "LD H,A",
+    /* 68 */ "LD L,B", "LD L,C", "LD L,D", "LD L,E", "LD L,H", "LD L,L", "LD L,(HL)", "LD L,A",
+    /* 70 */ "LD (HL),B", "LD (HL),C", "LD (HL),D", "LD (HL),E", "LD (HL),H", "LD (HL),L", "HALT", "LD (HL),A",
+    /* 78 */ "LD A,B", "LD A,C", "LD A,D", "LD A,E", "LD A,H", "LD A,L", "LD A,(HL)", "LD A,A",
+    /* 80 */ "ADD A,B", "ADD A,C", "ADD A,D", "ADD A,E", "ADD A,H", "ADD A,L", "ADD A,(HL)", "ADD A,A",
+    /* 88 */ "ADC A,B", "ADC A,C", "ADC A,D", "ADC A,E", "ADC A,H", "ADC A,L", "ADC A,(HL)", "ADC A,A",
+    /* 90 */ "SUB B", "SUB C", "SUB D", "SUB E", "SUB H", "SUB L", "SUB (HL)", "SUB A",
+    /* 98 */ "SBC A,B", "SBC A,C", "SBC A,D", "SBC A,E", "SBC A,H", "SBC A,L", "SBC A,(HL)", "SBC A,A",
+    /* A0 */ "AND B", "AND C", "AND D", "AND E", "AND H", "AND L", "AND (HL)", "AND A",
+    /* A8 */ "XOR B", "XOR C", "XOR D", "XOR E", "XOR H", "XOR L", "XOR (HL)", "XOR A",
+    /* B0 */ "OR B", "OR C", "OR D", "OR E", "OR H", "OR L", "OR (HL)", "OR A",
+    /* B8 */ "CP B", "CP C", "CP D", "CP E", "CP H", "CP L", "CP (HL)", "CP A",
+    /* C0 */ "RET NZ", "POP BC", "JP NZ,a16", "JP a16", "CALL NZ,a16", "PUSH BC", "ADD A,d8", "RST 00H",
+    /* C8 */ "RET Z", "RET", "JP Z,a16", "PREFIX CB", "CALL Z,a16", "CALL a16", "ADC A,d8", "RST 08H",
+    /* D0 */ "RET NC", "POP DE", "JP NC,a16", "", "CALL NC,a16", "PUSH DE", "SUB d8", "RST 10H",
+    /* D8 */ "RET C", "RETI", "JP C,a16", "", "CALL C,a16", "", "SBC A,d8", "RST 18H",
+    /* E0 */ "LDH (a8),A", "POP HL", "LD (C),A", "", "", "PUSH HL", "AND d8", "RST 20H",
+    /* E8 */ "ADD SP,e8", "JP HL", "LD (a16),A", "", "", "", "XOR d8", "RST 28H",
+    /* F0 */ "LDH A,(a8)", "POP AF", "LD A,(C)", "DI", "", "PUSH AF", "OR d8", "RST 30H",
+    /* F8 */ "LD HL,SP+e8", "LD SP,HL", "LD A,(a16)", "EI", "", "", "CP d8", "RST 38H",
+};
+
+static const uint8_t lengths[256] = {
+    /* 00 */ 1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    /* 10 */ 2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    /* 20 */ 2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    /* 30 */ 2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    /* 40 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 50 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 60 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 70 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 80 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 90 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* A0 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* B0 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* C0 */ 1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    /* D0 */ 1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    /* E0 */ 2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    /* F0 */ 2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+static const char *const registers[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+
+
+void disasm_init(DISASM_CACHE *cache){
+    memset(cache, 0, sizeof(DISASM_CACHE));
+    for(int i = 0; i < DISASM_CACHE_SIZE; i++) cache->lines[i].key = DISASM_NO_KEY;
+    cache->rom_key = DISASM_NO_KEY;
+}
+
+
+
+/* Bytes taken by the instruction starting with opcode, the prefix included */
+uint8_t disasm_length(uint8_t opcode){
+    return lengths[opcode];
+}
+
+
+
+/* Reads memory as the CPU would see it, without the access restrictions */
+static uint8_t peek(uint16_t addr){
+    if(addr < 0x100 && boot_rom_enabled) return boot[addr];
+    return addr < ROM_SIZE ? rom[addr] : MEM(addr);
+}
+
+/* Bank of addr, the same as trace_bank gives for the records */
+static uint8_t bank(uint16_t addr){
+    return addr >= 0x4000 && addr < ROM_SIZE ? 1 : 0;
+}
+
+
+
+/* This function writes the instruction in bytes, found at addr, as text.
+   Returns its length in bytes. */
+int disasm_decode(uint16_t addr, const uint8_t bytes[3], char *text, size_t len){
+    uint8_t opcode = bytes[0];
+    if(opcode == 0xCB){
+        static const char *const shifts[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+        static const char *const bits[4] = { NULL, "BIT", "RES", "SET" };
+        uint8_t cb = bytes[1];
+        if(cb < 0x40) snprintf(text, len, "%s %s", shifts[cb >> 3], registers[cb & 7]);
+        else snprintf(text, len, "%s %d,%s", bits[cb >> 6], (cb >> 3) & 7, registers[cb & 7]);
+        return 2;
+    }
+
+    const char *m = mnemonics[opcode];
+    if(m[0] == '\0'){
+        snprintf(text, len, "DB $%02X", opcode);
+        return 1;
+    }
+
+    size_t n = 0;
+    uint16_t word = bytes[1] | bytes[2] << 8;
+    int8_t offset = (int8_t)bytes[1];
+    while(*m != '\0' && n + 1 < len){
+        if(!islower((unsigned char)*m)){
+            text[n++] = *m++;
+            continue;
+        }
+        char operand[8];
+        bool wide = m[1] == '1';
+        switch(*m){
+            case 'd': snprintf(operand, sizeof(operand), wide ? "$%04X" : "$%02X", wide ? word : bytes[1]); break;
+            case 'a': snprintf(operand, sizeof(operand), wide ? "$%04X" : "$FF%02X", wide ? word : bytes[1]); break;
+            case 'r': snprintf(operand, sizeof(operand), "$%04X", (uint16_t)(addr + 2 + offset)); break;
+            default:
+                // e8, a negative offset takes the place of the + in SP+e8
+                if(offset < 0 && text[n - 1] == '+') text[n - 1] = '-';
+                else if(offset < 0) text[n++] = '-';
+                snprintf(operand, sizeof(operand), "$%02X", offset < 0 ? -offset : offset);
+                break;
+        }
+        m += wide ? 3 : 2;
+        n += snprintf(text + n, len - n, "%s", operand);
+        if(n >= len) n = len - 1;
+    }
+    text[n] = '\0';
+    return lengths[opcode];
+}
+
+
+
+/* This function returns the line of the instruction at addr, decoding it
+   only if it is not cached or its bytes changed since */
+const DISASM_LINE *disasm_line(DISASM_CACHE *cache, uint16_t addr){
+    uint8_t bytes[3] = { peek(addr), peek(addr + 1), peek(addr + 2) };
+    uint32_t key = (uint32_t)bank(addr) << 16 | addr;
+    DISASM_LINE *line = &cache->lines[addr & (DISASM_CACHE_SIZE - 1)];
+    if(line->key == key && memcmp(line->bytes, bytes, line->length) == 0){
+        cache->hits++;
+        return line;
+    }
+
+    cache->misses++;
+    line->key = key;
+    memcpy(line->bytes, bytes, sizeof(bytes));
+    line->length = disasm_decode(addr, bytes, line->text, sizeof(line->text));
+    return line;
+}
+
+
+
+/* Adds the starts of the lines from 'from' up to 'to' to the index, reading
+   the opcodes from base, which holds the address origin. One always starts
+   at anchor even if it falls inside an instruction. */
+static int sweep(DISASM_CACHE *cache, int n, const uint8_t *base, uint32_t origin, uint32_t from, uint32_t to, uint32_t anchor, uint32_t *end){
+    uint32_t addr = from;
+    while(addr < to){
+        cache->starts[n++] = addr;
+        uint32_t next = addr + lengths[base[addr - origin]];
+        if(addr < anchor && next > anchor) next = anchor;
+        addr = next;
+    }
+    *end = addr;
+    return n;
+}
+
+static int find(const uint16_t *starts, int count, uint16_t addr){
+    int lo = 0, hi = count - 1;
+    while(lo < hi){
+        int mid = (lo + hi + 1) / 2;
+        if(starts[mid] <= addr) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+/* This function finds where the lines of the whole address space start,
+   disassembling from 0 and from anchor, usually PC. The ROM part is swept
+   again only when the anchor is inside one of its lines or the boot ROM was
+   unmapped, the RAM part every time as its code can change. Returns the
+   count. */
+int disasm_index(DISASM_CACHE *cache, uint16_t anchor){
+    uint32_t key = boot_rom_enabled;
+    bool inside = anchor < ROM_SIZE && cache->starts[find(cache->starts, cache->rom_count, anchor)] != anchor;
+    if(key != cache->rom_key || inside){
+        uint32_t rom_anchor = anchor < ROM_SIZE ? anchor : 0, end = 0;
+        int n = boot_rom_enabled ? sweep(cache, 0, boot, 0, 0, sizeof(boot), rom_anchor, &end) : 0;
+        cache->rom_count = sweep(cache, n, rom, 0, end, ROM_SIZE, rom_anchor, &cache->rom_end);
+        cache->rom_key = key;
+    }
+    uint32_t end;
+    cache->count = sweep(cache, cache->rom_count, ram, ROM_SIZE, cache->rom_end, 0x10000, anchor, &end);
+    return cache->count;
+}
+
+
+
+/* This function returns the line of the index holding addr, the last one
+   starting at or before it */
+int disasm_find(const DISASM_CACHE *cache, uint16_t addr){
+    return find(cache->starts, cache->count, addr);
+}
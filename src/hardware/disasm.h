@@ -0,0 +1,44 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DISASM_TEXT_MAX   24      // longest line is "LD HL,SP+$7F" plus room
+#define DISASM_CACHE_SIZE 4096    // lines, must be a power of 2
+#define DISASM_NO_KEY     UINT32_MAX
+
+/* A decoded instruction, keyed by bank << 16 | address. The bytes it was
+   decoded from are kept to notice when code in RAM is rewritten. */
+typedef struct DISASM_LINE {
+    uint32_t key;
+    uint8_t bytes[3];
+    uint8_t length;
+    char text[DISASM_TEXT_MAX];
+} DISASM_LINE;
+
+/* Lines decoded for the debugger. The cache is direct mapped and a line is
+   decoded again when the bytes at its address no longer match, that is how
+   code rewritten in RAM or the boot ROM going away is noticed without making
+   the writes of the emulation do anything. The index holds where each line
+   of the address space starts. */
+typedef struct DISASM_CACHE {
+    DISASM_LINE lines[DISASM_CACHE_SIZE];
+    uint64_t hits, misses;
+
+    uint16_t starts[0x10000];
+    int count;
+    int rom_count;      // lines of the index below ROM_SIZE
+    uint32_t rom_end;   // where the first line after them starts
+    uint32_t rom_key;   // whether the boot ROM was mapped when it was swept, DISASM_NO_KEY before the first
+} DISASM_CACHE;
+
+void disasm_init(DISASM_CACHE *cache);
+uint8_t disasm_length(uint8_t opcode);
+int disasm_decode(uint16_t addr, const uint8_t bytes[3], char *text, size_t len);
+const DISASM_LINE *disasm_line(DISASM_CACHE *cache, uint16_t addr);
+int disasm_index(DISASM_CACHE *cache, uint16_t anchor);
+int disasm_find(const DISASM_CACHE *cache, uint16_t addr);
+
+#endif
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator.h"
+
+EMULATOR *bound_emulator = NULL;
+
+static TRACER *tracer = NULL;            // execution trace, NULL when tracing is off
+static EMULATOR *traced_emulator = NULL;
+static BREAKPOINTS *breakpoints = NULL;
+static EMULATOR *debugged_emulator = NULL;
+
+
+/* This function allows the cpu to correctly handle interrupts */
+int handleInterrupts(CPU *cpu){
+    uint8_t IE = ReadMem(IE_REG);
+    uint8_t IF = ReadMem(IF_REG);
+
+    uint8_t requested = IE & IF;
+
+    if(!cpu->IME){
+        if(requested != 0) cpu->halted = false; // pending interrupt wakes up cpu
+        return 0;
+    }
+
+
+    if (requested == 0) {
+        return 0;
+    }
+
+    // An interrupt is happening, so the CPU is no longer halted
+    cpu->halted = false;
+    cpu->IME = false; // Disable further interrupts
+
+    // Push PC to the stack
+    cpu->SP -= 2;
+    WriteMem(cpu->SP, (uint8_t)(cpu->PC & 0xFF));
+    WriteMem(cpu->SP + 1, (uint8_t)(cpu->PC >> 8));
+
+    // Check interrupts in order of priority
+    if (requested & 0x01) { // V-Blank
+        MEM(IF_REG) &= ~0x01; // Clear the request flag
+        cpu->PC = 0x0040;
+    } else if (requested & 0x02) { // LCD STAT
+        MEM(IF_REG) &= ~0x02;
+        cpu->PC = 0x0048;
+    } else if (requested & 0x04) { // Timer
+        MEM(IF_REG) &= ~0x04;
+        cpu->PC = 0x0050;
+    } else if (requested & 0x08) { // Serial
+        MEM(IF_REG) &= ~0x08;
+        cpu->PC = 0x0058;
+    } else if (requested & 0x10) { // Joypad
+        MEM(IF_REG) &= ~0x10;
+        cpu->PC = 0x0060;
+    }
+
+    return 20;
+}
+
+
+void InitializePowerOnState(CPU *cpu, PPU *ppu){
+    cpu->PC = 0x0000;
+    cpu->SP = 0x0000;
+    cpu->AF = 0x0000;
+    cpu->BC = 0x0000;
+    cpu->DE = 0x0000;
+    cpu->HL = 0x0000;
+    
+    cpu->halted = false;
+    cpu->running = true;
+    cpu->IME = false;
+
+    // Initialize PPU state properly
+    ppu->mode = MODE_2_OAM_SCAN;
+    ppu->cycle_counter = 0;
+    ppu->ly = 0;
+
+    // Initialize I/O registers
+    MEM(0xFF00) = 0xCF; // Joypad input
+    MEM(TIMA_REG) = 0x00; MEM(TMA_REG) = 0x00; MEM(TAC_REG) = 0x00;
+    MEM(0xFF10) = 0x80; MEM(0xFF11) = 0xBF; MEM(0xFF12) = 0xF3;
+    MEM(0xFF14) = 0xBF; MEM(0xFF16) = 0x3F; MEM(0xFF17) = 0x00;
+    MEM(0xFF19) = 0xBF; MEM(0xFF1A) = 0x7F; MEM(0xFF1B) = 0xFF;
+    MEM(0xFF1C) = 0x9F; MEM(0xFF1E) = 0xBF; MEM(0xFF20) = 0xFF;
+    MEM(0xFF21) = 0x00; MEM(0xFF22) = 0x00; MEM(0xFF23) = 0xBF;
+    MEM(0xFF24) = 0x77; MEM(0xFF25) = 0xF3; MEM(0xFF26) = 0xF1;
+    MEM(0xFF41) = 0x02; // STAT - Start in mode 2 (OAM scan)
+    MEM(0xFF42) = 0x00; // SCY
+    MEM(0xFF43) = 0x00; // SCX
+    MEM(0xFF44) = 0x00; // LY - will be updated by PPU
+    MEM(0xFF45) = 0x00; // LYC
+    MEM(0xFF47) = 0xE4; // BGP - Better palette: 11 10 01 00
+    MEM(0xFF48) = 0xFF; MEM(0xFF49) = 0xFF;
+    MEM(0xFF4A) = 0x00; MEM(0xFF4B) = 0x00;
+    MEM(IE_REG) = 0x00;
+}
+
+
+
+/* This function prepares an emulator instance running the cartridge passed
+   in its power on state and leaves it bound */
+void emulator_init(EMULATOR *emu, const CARTRIDGE *cart, void (*process_frame_buffer)(int x, int y, uint8_t color)){
+    if(bound_emulator == emu) bound_emulator = NULL; // the globals must not be saved back over the reset
+    memset(emu, 0, sizeof(EMULATOR));
+    emu->boot_rom_enabled = true;
+    emu->joypad_events.next_cycle = UINT32_MAX;
+    emu->ppu.process_frame_buffer = process_frame_buffer;
+    emu->rom = cart->rom;
+
+    emulator_bind(emu);
+    InitializePowerOnState(&emu->cpu, &emu->ppu);
+}
+
+
+
+/* This function makes the hardware modules work on the emulator passed. The 
+   state of the previously bound emulator is saved back into its instance. */
+void emulator_bind(EMULATOR *emu){
+    if(bound_emulator == emu) return;
+
+    emulator_sync();
+
+    timer  = emu->timer;
+    dma    = emu->dma;
+    joypad = emu->joypad;
+    joypad_events    = emu->joypad_events;
+    serial           = emu->serial;
+    boot_rom_enabled = emu->boot_rom_enabled;
+    rom    = emu->rom;
+    ram    = emu->ram;
+
+    bound_emulator = emu;
+}
+
+
+
+/* This function copies the module globals back into the bound emulator so
+   that its instance is complete, it stays bound */
+void emulator_sync(void){
+    if(bound_emulator == NULL) return;
+
+    bound_emulator->timer  = timer;
+    bound_emulator->dma    = dma;
+    bound_emulator->joypad = joypad;
+    bound_emulator->joypad_events    = joypad_events;
+    bound_emulator->serial           = serial;
+    bound_emulator->boot_rom_enabled = boot_rom_enabled;
+}
+
+
+
+/* This function copies the state of the emulator inside the buffer, that 
+   must have EMULATOR_STATE_SIZE bytes. The state is the instance as it is in
+   memory so it can only be loaded by the same build. */
+void emulator_save_state(EMULATOR *emu, uint8_t *buf){
+    if(bound_emulator == emu) emulator_sync();
+
+    EMULATOR_STATE_HEADER header = { EMULATOR_STATE_MAGIC, sizeof(EMULATOR) };
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), emu, sizeof(EMULATOR));
+}
+
+
+
+/* This function restores a state saved by emulator_save_state. What does 
+   not belong to the state (the ROM, the frame buffer callback and the serial
+   backend) is kept from the emulator. Returns false if the state is not 
+   valid, the emulator is left untouched. */
+bool emulator_load_state(EMULATOR *emu, const uint8_t *buf, size_t len){
+    EMULATOR_STATE_HEADER header;
+    if(len != EMULATOR_STATE_SIZE) return false;
+    memcpy(&header, buf, sizeof(header));
+    if(header.magic != EMULATOR_STATE_MAGIC || header.size != sizeof(EMULATOR)) return false;
+
+    const uint8_t *rom_ptr = emu->rom;
+    void (*process_frame_buffer)(int x, int y, uint8_t color) = emu->ppu.process_frame_buffer;
+    SERIAL_BACKEND *backend = bound_emulator == emu ? serial.backend : emu->serial.backend;
+
+    memcpy(emu, buf + sizeof(header), sizeof(EMULATOR));
+    emu->rom = rom_ptr;
+    emu->ppu.process_frame_buffer = process_frame_buffer;
+    emu->serial.backend = backend;
+
+    if(bound_emulator == emu){
+        bound_emulator = NULL; // the globals are stale, load them from the state
+        emulator_bind(emu);
+    }
+    return true;
+}
+
+
+
+
+/* This function records the instruction at PC when the filter of the trace
+   passes it. Nothing is recorded while the boot ROM runs, the logs of the
+   test ROMs start at 0x0100. */
+static void trace_instruction(TRACER *t, CPU *cpu){
+    TRACE_FILTER *filter = &t->filter;
+    if(!t->enabled || boot_rom_enabled) return;
+
+    if(!t->triggered){
+        if(filter->trigger == TRACE_TRIGGER_PC && cpu->PC != filter->trigger_addr) return;
+        if(filter->trigger == TRACE_TRIGGER_MEM){
+            uint16_t addr = filter->trigger_addr;
+            if((addr < ROM_SIZE ? rom[addr] : MEM(addr)) != filter->trigger_value) return;
+        }
+        t->triggered = true;
+    }
+    if(cpu->PC < filter->pc_min || cpu->PC > filter->pc_max) return;
+    if(t->cycle < filter->cycle_min || t->cycle > filter->cycle_max) return;
+    if(filter->limit != 0 && t->recorded >= filter->limit) return;
+
+    // reads have no side effects, the trace does not change the emulation
+    uint8_t mem[4] = { ReadMem(cpu->PC), ReadMem(cpu->PC + 1), ReadMem(cpu->PC + 2), ReadMem(cpu->PC + 3) };
+    trace_record(t, cpu, mem);
+}
+
+
+
+/* This function executes one instruction (or services an interrupt) on the 
+   bound emulator and advances all the other components by the same amount of
+   cycles. t is the trace to record into, it is always NULL in the loop that
+   runs without tracing so that loop does not test it. Returns the cycles 
+   executed. */
+static inline int step(EMULATOR *emu, TRACER *t){
+    CPU *cpu = &emu->cpu;
+    int cycles_executed = 0;
+
+    // First, check if an interrupt needs to be serviced.
+    cycles_executed += handleInterrupts(cpu);
+
+    if(t != NULL) trace_instruction(t, cpu);
+
+    if (cpu->halted) {
+        cycles_executed += 4;
+    } else {
+        uint8_t opcode = FetchByte(cpu); 
+        cycles_executed = instruction_table[opcode](cpu);
+    }
+
+    if(t != NULL) t->cycle += cycles_executed;
+
+    ppu_step(&emu->ppu, cycles_executed);
+    timer_step(cycles_executed);
+    dma_step(cycles_executed);
+    serial_step(cycles_executed);
+
+    return cycles_executed;
+}
+
+
+
+/* This function executes one instruction on the bound emulator, recording
+   it when the emulator is traced. Returns the cycles executed. */
+int emulator_step(EMULATOR *emu){
+    return step(emu, emu == traced_emulator ? tracer : NULL);
+}
+
+
+
+/* Run loop of the emulator with armed breakpoints, it stops before an
+   instruction where one of them holds */
+static int run_checked(EMULATOR *emu, BREAKPOINTS *bps, int cycle, int end_cycle){
+    TRACER *t = emulator_tracer(emu);
+    while(cycle < end_cycle && emu->cpu.running){
+        if((uint32_t)cycle >= joypad_events.next_cycle) joypad_apply_events(cycle);
+        if(bps->resume) bps->resume = false;
+        else if((bps->pages[emu->cpu.PC >> 8] || bps->stepping) && breakpoint_stop(bps, &emu->cpu)) break;
+        cycle += step(emu, t);
+    }
+    return cycle;
+}
+
+
+
+/* This function runs the bound emulator from cycle up to end_cycle of the 
+   current frame, applying the joypad events scheduled in between. Returns the
+   cycle reached, that can be a few cycles past end_cycle, or less when a 
+   breakpoint stopped it. The traced emulator and the one with breakpoints 
+   run in loops of their own so both cost nothing when they are off. */
+int emulator_run(EMULATOR *emu, int cycle, int end_cycle){
+    if(emu == debugged_emulator && breakpoints_armed(breakpoints)) return run_checked(emu, breakpoints, cycle, end_cycle);
+
+    if(emu == traced_emulator){
+        TRACER *t = tracer;
+        while(cycle < end_cycle && emu->cpu.running){
+            if((uint32_t)cycle >= joypad_events.next_cycle) joypad_apply_events(cycle);
+            cycle += step(emu, t);
+        }
+        return cycle;
+    }
+
+    while(cycle < end_cycle && emu->cpu.running){
+        if((uint32_t)cycle >= joypad_events.next_cycle) joypad_apply_events(cycle);
+        cycle += step(emu, NULL);
+    }
+    return cycle;
+}
+
+
+
+/* This function attaches the trace passed to the emulator, from now on its
+   instructions are recorded as the filter of the trace says. One emulator is
+   traced at a time, NULL detaches the trace. */
+void emulator_set_tracer(EMULATOR *emu, TRACER *t){
+    tracer = t;
+    traced_emulator = t != NULL ? emu : NULL;
+}
+
+
+
+/* This function attaches the breakpoints passed to the emulator, they are
+   checked while they are armed. NULL detaches them. */
+void emulator_set_breakpoints(EMULATOR *emu, BREAKPOINTS *bps){
+    breakpoints = bps;
+    debugged_emulator = bps != NULL ? emu : NULL;
+}
+
+
+
+/* This function returns the trace attached to the emulator, NULL if it is
+   not traced */
+TRACER *emulator_tracer(EMULATOR *emu){
+    return emu == traced_emulator ? tracer : NULL;
+}
+
+
+
+/* This function runs two emulators connected by a link cable for the amount
+   of cycles passed. They are advanced alternately by quantum cycles so that 
+   when a transfer completes the peer is never more than a quantum away, with 
+   a quantum of one serial bit the exchange is bit accurate. The first emulator
+   is left bound. */
+void emulator_run_linked(EMULATOR *a, EMULATOR *b, int cycles, int quantum){
+    int cycle_a = 0, cycle_b = 0;
+
+    for(int end = quantum; cycle_a < cycles && a->cpu.running; end += quantum){
+        if(end > cycles) end = cycles;
+        emulator_bind(b);
+        if(b->cpu.running) cycle_b = emulator_run(b, cycle_b, end);
+        emulator_bind(a);
+        cycle_a = emulator_run(a, cycle_a, end);
+    }
+
+    // events that did not fall inside the frame are not carried to the next one
+    joypad_apply_events(UINT32_MAX);
+}
+
+
+
+/* Copies the status of the emulator inside the buffer, the provided buffer 
+   must be at least 82 bytes
+*/
+void GetEmulatorStatus(char* buf, CPU *cpu){
+    uint8_t a =  cpu->AF >> 8;
+    uint8_t f = (cpu->AF & 0xFF);
+    uint8_t b =  cpu->BC >> 8;
+    uint8_t c = (cpu->BC & 0xFF);
+    uint8_t d =  cpu->DE >> 8;
+    uint8_t e = (cpu->DE & 0xFF);
+    uint8_t h =  cpu->HL >> 8;
+    uint8_t l = (cpu->HL & 0xFF);
+    sprintf(buf, "A: %02X F: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X SP: %04X PC: 00:%04X (%02X %02X %02X %02X)\n", a, f, b, c, d, e, h, l, cpu->SP, cpu->PC, ReadMem(cpu->PC), ReadMem(cpu->PC+1), ReadMem(cpu->PC+2), ReadMem(cpu->PC+3));
+}
+
@@ -0,0 +1,75 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cpu.h"
+#include "ppu.h"
+#include "timer.h"
+#include "memory.h"
+#include "joypad.h"
+#include "serial.h"
+#include "trace.h"
+#include "breakpoint.h"
+
+#define CYCLES_PER_FRAME 70224 // 154 lines of 456 cycles
+#define LINK_QUANTUM_CYCLES SERIAL_CYCLES_PER_BIT
+#define EMULATOR_ALIGNMENT 64 // cache line size
+
+/* Definition of a whole emulator instance. The hardware modules work on the 
+   instance bound with emulator_bind: rom and ram point to its address space
+   and the peripheral state (timer, dma, joypad, serial, boot ROM flag) is copied 
+   into the module globals while it is bound and back when it is unbound.
+   The ROM is shared with the other instances running the same cartridge, an 
+   instance only owns the mutable part of the address space (0x8000-0xFFFF).
+   Fields are ordered by how often they are touched: what every instruction
+   uses (registers, ROM pointer, PPU, timer, DMA) fills the first two cache 
+   lines, the state touched a few times per frame follows and the address 
+   space comes last, starting on its own cache line. */
+typedef struct EMULATOR {
+    _Alignas(EMULATOR_ALIGNMENT) CPU cpu;
+    const uint8_t *rom;
+    PPU ppu;
+    TIMER timer;
+    DMA dma;
+
+    SERIAL serial;
+    JOYPAD joypad;
+    bool boot_rom_enabled;
+    JOYPAD_EVENT_QUEUE joypad_events;
+
+    _Alignas(EMULATOR_ALIGNMENT) uint8_t ram[0x10000 - ROM_SIZE]; // VRAM, cartridge RAM, WRAM, OAM, IO and HRAM
+} EMULATOR;
+
+_Static_assert(offsetof(EMULATOR, serial) <= 2 * EMULATOR_ALIGNMENT, "hot emulator state must fit in two cache lines");
+
+#define EMULATOR_STATE_MAGIC 0x53534247 // "GBSS"
+#define EMULATOR_STATE_SIZE (sizeof(EMULATOR_STATE_HEADER) + sizeof(EMULATOR))
+
+/* Header of a saved state, followed by the instance */
+typedef struct EMULATOR_STATE_HEADER {
+    uint32_t magic;
+    uint32_t size; // sizeof(EMULATOR) of the build that saved it
+} EMULATOR_STATE_HEADER;
+
+extern EMULATOR *bound_emulator;
+
+void emulator_init(EMULATOR *emu, const CARTRIDGE *cart, void (*process_frame_buffer)(int x, int y, uint8_t color));
+void emulator_bind(EMULATOR *emu);
+void emulator_sync(void);
+void emulator_save_state(EMULATOR *emu, uint8_t *buf);
+bool emulator_load_state(EMULATOR *emu, const uint8_t *buf, size_t len);
+int emulator_step(EMULATOR *emu);
+int emulator_run(EMULATOR *emu, int cycle, int end_cycle);
+void emulator_run_linked(EMULATOR *a, EMULATOR *b, int cycles, int quantum);
+void emulator_set_tracer(EMULATOR *emu, TRACER *t);
+TRACER *emulator_tracer(EMULATOR *emu);
+void emulator_set_breakpoints(EMULATOR *emu, BREAKPOINTS *bps);
+
+int handleInterrupts(CPU *cpu);
+void InitializePowerOnState(CPU *cpu, PPU *ppu);
+void GetEmulatorStatus(char* buf, CPU *cpu);
+
+#endif
@@ -1,3 +1,66 @@
 #include "joypad.h"
+#include "memory.h"
 
-JOYPAD joypad = {0};
\ No newline at end of file
+JOYPAD joypad = {0};
+JOYPAD_EVENT_QUEUE joypad_events = { .next_cycle = UINT32_MAX };
+
+
+/* This function changes the state of a button, pressing a button that was 
+   released requests the joypad interrupt */
+void joypad_set_button(JOYPAD_BUTTON button, bool pressed){
+    bool *state;
+    switch(button){
+        case JOYPAD_RIGHT:  state = &joypad.right;  break;
+        case JOYPAD_LEFT:   state = &joypad.left;   break;
+        case JOYPAD_UP:     state = &joypad.up;     break;
+        case JOYPAD_DOWN:   state = &joypad.down;   break;
+        case JOYPAD_A:      state = &joypad.a;      break;
+        case JOYPAD_B:      state = &joypad.b;      break;
+        case JOYPAD_SELECT: state = &joypad.select; break;
+        case JOYPAD_START:  state = &joypad.start;  break;
+        default: return;
+    }
+
+    if(pressed && !*state){ // Request joypad interrupt
+        MEM(IF_REG) |= 0x10;
+    }
+    *state = pressed;
+}
+
+
+
+/* This function schedules a button change at a cycle of the current frame.
+   Cycles are kept non decreasing so events are applied in the order they were
+   pushed. Returns false if the queue is full and the event was lost. */
+bool joypad_push_event(JOYPAD_BUTTON button, bool pressed, uint32_t cycle){
+    JOYPAD_EVENT_QUEUE *q = &joypad_events;
+    if(q->tail - q->head == JOYPAD_EVENT_QUEUE_SIZE) return false;
+
+    if(q->tail != q->head){
+        uint32_t last_cycle = q->events[(q->tail - 1) & (JOYPAD_EVENT_QUEUE_SIZE - 1)].cycle;
+        if(cycle < last_cycle) cycle = last_cycle;
+    }
+
+    q->events[q->tail & (JOYPAD_EVENT_QUEUE_SIZE - 1)] = (JOYPAD_EVENT){ cycle, button, pressed };
+    if(q->tail == q->head) q->next_cycle = cycle;
+    q->tail++;
+    return true;
+}
+
+
+
+/* This function applies all the events scheduled up to the cycle passed. The
+   emulation loop only calls it when cycle >= joypad_events.next_cycle */
+void joypad_apply_events(uint32_t cycle){
+    JOYPAD_EVENT_QUEUE *q = &joypad_events;
+
+    while(q->head != q->tail){
+        JOYPAD_EVENT *event = &q->events[q->head & (JOYPAD_EVENT_QUEUE_SIZE - 1)];
+        if(event->cycle > cycle) break;
+        joypad_set_button(event->button, event->pressed);
+        q->head++;
+    }
+
+    q->next_cycle = (q->head == q->tail) ? UINT32_MAX
+                                         : q->events[q->head & (JOYPAD_EVENT_QUEUE_SIZE - 1)].cycle;
+}
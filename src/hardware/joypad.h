@@ -2,6 +2,14 @@
 #define JOYPAD_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#define JOYPAD_EVENT_QUEUE_SIZE 64 // must be a power of 2
+
+typedef enum {
+    JOYPAD_RIGHT, JOYPAD_LEFT, JOYPAD_UP, JOYPAD_DOWN,
+    JOYPAD_A, JOYPAD_B, JOYPAD_SELECT, JOYPAD_START
+} JOYPAD_BUTTON;
 
 /* JoyPad state struct */
 typedef struct JOYPAD {
@@ -9,6 +17,26 @@ typedef struct JOYPAD {
     bool down, up, left, right;
 } JOYPAD;
 
+/* Button change scheduled at a cycle of the current emulated frame */
+typedef struct JOYPAD_EVENT {
+    uint32_t cycle;
+    JOYPAD_BUTTON button;
+    bool pressed;
+} JOYPAD_EVENT;
+
+/* Ring buffer of pending events, ordered by cycle */
+typedef struct JOYPAD_EVENT_QUEUE {
+    JOYPAD_EVENT events[JOYPAD_EVENT_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t next_cycle; // cycle of the first pending event, UINT32_MAX when empty
+} JOYPAD_EVENT_QUEUE;
+
 extern JOYPAD joypad;
+extern JOYPAD_EVENT_QUEUE joypad_events;
+
+void joypad_set_button(JOYPAD_BUTTON button, bool pressed);
+bool joypad_push_event(JOYPAD_BUTTON button, bool pressed, uint32_t cycle);
+void joypad_apply_events(uint32_t cycle);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,18 +4,23 @@
 #include "ppu.h"
 #include "timer.h"
 #include "joypad.h"
+#include "serial.h"
 
 bool boot_rom_enabled = true;
+bool doctor_ly = false;
 uint8_t boot[256];
-uint8_t memory[65536];
+const uint8_t *rom;
+uint8_t *ram;
 
 DMA dma = {0};
 
 void WriteMem(uint16_t addr, uint8_t data){
+    if(addr < ROM_SIZE) return; // there is no bank controller, the ROM is read only
+
     uint8_t ppu_mode = ppu_get_mode();
 
     //Check for VRAM read restrictions
-    uint8_t LCDC = memory[0xFF40];
+    uint8_t LCDC = MEM(0xFF40);
     if((LCDC >> 7) == 1){ // LCD and PPU are enabled
         if (addr >= 0x8000 && addr <= 0x9FFF) {
             if (ppu_mode == MODE_3_DRAWING) {
@@ -37,14 +42,19 @@ void WriteMem(uint16_t addr, uint8_t data){
 
     if(addr == 0xFF46){ // DMA transfer
         uint16_t transfer_source = data * 0x0100;
-        memcpy(&memory[0xFE00], &memory[transfer_source], 40*4); // 40 sprites 4 byte each
+        const uint8_t *source = transfer_source < ROM_SIZE ? &rom[transfer_source] : &MEM(transfer_source);
+        memcpy(&MEM(0xFE00), source, 40*4); // 40 sprites 4 byte each
         dma.running = true;
         dma.cycles = 0;
     }
 
-    if(addr != DIV_REG) memory[addr] = data;
+    if(addr == SC_REG){
+        serial_write_control(data);
+    }
+
+    if(addr != DIV_REG) MEM(addr) = data;
     else { // writing DIV register resets it
-        memory[DIV_REG] = 0x00; 
+        MEM(DIV_REG) = 0x00; 
         timer.div_cycle_counter = 0;
         timer.tima_cycle_counter = 0;
     }
@@ -60,13 +70,11 @@ uint8_t ReadMem(uint16_t addr){
         }
     }
 
-    #ifdef DEBUG_TEST_LOG
-        if(addr == 0xFF44) return 0x90;
-    #endif
+    // the logs of gameboy-doctor are taken with the PPU stubbed out
+    if(doctor_ly && addr == 0xFF44) return 0x90;
 
     // Check for VRAM read restrictions
-    //Check for VRAM read restrictions
-    uint8_t LCDC = memory[0xFF40];
+    uint8_t LCDC = MEM(0xFF40);
     if((LCDC >> 7) == 1){ // LCD and PPU are enabled
         if (addr >= 0x8000 && addr <= 0x9FFF) {
             if (ppu_mode == MODE_3_DRAWING) {
@@ -87,7 +95,7 @@ uint8_t ReadMem(uint16_t addr){
     }
 
     if(addr == 0xFF00){
-        uint8_t P1 = memory[0xFF00];
+        uint8_t P1 = MEM(0xFF00);
         P1 |= 0x0F; // all buttons unpressed (0 pressed 1 unpressed)
         if((P1 & 0x10) == 0){ // D-Pad buttons
             if (joypad.right) P1 &= ~0x01; // Bit 0 (Right)
@@ -104,7 +112,8 @@ uint8_t ReadMem(uint16_t addr){
         return P1;
     }
 
-    return memory[addr];
+    if(addr < ROM_SIZE) return rom[addr];
+    return MEM(addr);
 }
 
 /* This function fetches and returns a byte from memory at the address of
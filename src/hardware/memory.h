@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "cpu.h"
+#include "cartridge.h"
 
 // REGISTER DEFINED ADDRESSES
 #define DIV_REG  0xFF04 // Divider register
@@ -16,8 +17,15 @@
 #define IE_REG   0xFFFF // Interrupt enable register
 
 extern bool boot_rom_enabled;
+extern bool doctor_ly; // LY always reads 0x90 like in the gameboy-doctor logs, set with --doctor
 extern uint8_t boot[256];
-extern uint8_t memory[65536];
+extern const uint8_t *rom; // cartridge ROM of the bound emulator, 0x0000-0x7FFF
+extern uint8_t *ram;       // 0x8000-0xFFFF of the bound emulator, ram[0] is 0x8000
+
+/* Byte at a Game Boy address from 0x8000, in the RAM of an emulator or in
+   the one of the bound emulator */
+#define RAM_BYTE(ram, addr) ((ram)[(addr) - ROM_SIZE])
+#define MEM(addr) RAM_BYTE(ram, addr)
 
 uint8_t ReadMem(uint16_t addr);
 void WriteMem(uint16_t addr, uint8_t data);
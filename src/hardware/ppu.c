@@ -4,7 +4,7 @@
 
 /* This function returns the current PPU mode */
 uint8_t ppu_get_mode() {
-    return memory[0xFF41] & 0x03;
+    return MEM(0xFF41) & 0x03;
 }
 
 
@@ -14,7 +14,7 @@ uint8_t ppu_get_mode() {
 */
 void ppu_set_mode(PPU *ppu, PPU_MODE mode){
     ppu->mode = mode;
-    memory[0xFF41] = (memory[0xFF41] & 0b11111100) | mode;
+    MEM(0xFF41) = (MEM(0xFF41) & 0b11111100) | mode;
 }
 
 
@@ -49,7 +49,7 @@ void ppu_scanline(PPU *ppu){
            blocks reads in VRAM and OAM for CPU */
         uint16_t tile_map_addr = ((LCDC & 0b00001000) == 0 ? 0x9800 : 0x9C00); // Third bit of LCDC indicates the tile map location
         uint16_t tile_id_addr  = tile_map_addr + (tile_y * 32) + tile_x; // The address of the tile that is needed
-        uint8_t  tile_id       = memory[tile_id_addr]; // The tile id picked directly from memory  
+        uint8_t  tile_id       = MEM(tile_id_addr); // The tile id picked directly from memory  
 
         uint16_t tile_data_addr;
 
@@ -68,8 +68,8 @@ void ppu_scanline(PPU *ppu){
         /* The data is stored in two consecutive bytes, the first byte stores the least significant bit of the pixels 
            the second byte stores the most significant bit of the pixels  */
         
-        uint8_t byte1 = memory[tile_row_addr];
-        uint8_t byte2 = memory[tile_row_addr+1];
+        uint8_t byte1 = MEM(tile_row_addr);
+        uint8_t byte2 = MEM(tile_row_addr+1);
 
         uint8_t bit_index = 7 - (world_x % 8);
 
@@ -101,7 +101,7 @@ void ppu_scanline(PPU *ppu){
                the rest of calculation remains the same */
             tile_map_addr = ((LCDC & 0b01000000) == 0 ? 0x9800 : 0x9C00);
             tile_id_addr  = tile_map_addr + (tile_y * 32) + tile_x; 
-            tile_id       = memory[tile_id_addr];   
+            tile_id       = MEM(tile_id_addr);   
 
             if((LCDC & 0x10) != 0){ // Use 0x8000 method (unsigned)
                 tile_data_addr = 0x8000;
@@ -118,8 +118,8 @@ void ppu_scanline(PPU *ppu){
             /* The data is stored in two consecutive bytes, the first byte stores the least significant bit of the pixels 
             the second byte stores the most significant bit of the pixels */
             
-            byte1 = memory[tile_row_addr];
-            byte2 = memory[tile_row_addr+1];
+            byte1 = MEM(tile_row_addr);
+            byte2 = MEM(tile_row_addr+1);
 
             bit_index = 7 - (window_x % 8);
 
@@ -179,8 +179,8 @@ void ppu_scanline(PPU *ppu){
                     /* The data is stored in two consecutive bytes, the first byte stores the least significant bit of the pixels 
                     the second byte stores the most significant bit of the pixels */
                     
-                    byte1 = memory[tile_row_addr];
-                    byte2 = memory[tile_row_addr+1];
+                    byte1 = MEM(tile_row_addr);
+                    byte2 = MEM(tile_row_addr+1);
 
                     bit_index = 7 - (x_in_tile % 8);
 
@@ -227,10 +227,10 @@ int sprite_comparator(const void *a, const void *b){
 void ppu_oam_scan(PPU *ppu){
     ppu->visible_objects_counter = 0;
     /* Each object is 4 bytes in memory so let's read the memory as uint32_t values */
-    uint32_t *obj_base_addr_ptr = (uint32_t *)&memory[0xFE00];
-    uint32_t *obj_end_addr_ptr  = (uint32_t *)&memory[0xFE9F];
+    uint32_t *obj_base_addr_ptr = (uint32_t *)&MEM(0xFE00);
+    uint32_t *obj_end_addr_ptr  = (uint32_t *)&MEM(0xFE9F);
 
-    uint8_t LCDC = memory[0xFF40];
+    uint8_t LCDC = MEM(0xFF40);
     bool is_double_height = (LCDC & 0x04) != 0;
     uint8_t *obj;
     for(uint32_t *i = obj_base_addr_ptr; i < obj_end_addr_ptr; i++){
@@ -257,7 +257,7 @@ void ppu_oam_scan(PPU *ppu){
 void ppu_step(PPU *ppu, int cycles){
     ppu->cycle_counter += cycles;
 
-    uint8_t STAT   = memory[0xFF41];
+    uint8_t STAT   = MEM(0xFF41);
 
     switch(ppu->mode){
         case MODE_2_OAM_SCAN:
@@ -271,7 +271,7 @@ void ppu_step(PPU *ppu, int cycles){
                 ppu->cycle_counter -= 172;
                 ppu_set_mode(ppu, MODE_0_HBLANK);
                 // check if in STAT an interrupt for this event has to be requested
-                if((STAT & 0x08) != 0) memory[IF_REG] |= 0x02; // request STAT interrupt
+                if((STAT & 0x08) != 0) MEM(IF_REG) |= 0x02; // request STAT interrupt
                 ppu_scanline(ppu);
             }
             break;
@@ -279,35 +279,35 @@ void ppu_step(PPU *ppu, int cycles){
             if (ppu->cycle_counter >= 204) {
                 ppu->cycle_counter -= 204;
                 ppu->ly++;
-                memory[0xFF44] = ppu->ly;
-                uint8_t LYC    = memory[0xFF45];
+                MEM(0xFF44) = ppu->ly;
+                uint8_t LYC    = MEM(0xFF45);
                 
 
                 if(ppu->ly == LYC){
                     // Set coincidence Flag (second bit in stat)
-                    memory[0xFF41] |= 0x04;
-                    STAT = memory[0xFF41];
+                    MEM(0xFF41) |= 0x04;
+                    STAT = MEM(0xFF41);
                     
                     // Check if the interrupt for this event is enabled (bit 6)
                     if((STAT & 0x40) != 0){
-                        memory[IF_REG] |= 0x02; // request STAT interrupt
+                        MEM(IF_REG) |= 0x02; // request STAT interrupt
                     }
                 } else{
-                        memory[0xFF41] &= ~0x04;
-                        STAT = memory[0xFF41];
+                        MEM(0xFF41) &= ~0x04;
+                        STAT = MEM(0xFF41);
                 }
 
                 if (ppu->ly == 144) {
                     ppu_set_mode(ppu, MODE_1_VBLANK);
                     // check if in STAT an interrupt for this event has to be requested
-                    if((STAT & 0x10) != 0) memory[IF_REG] |= 0x02; // request STAT interrupt
+                    if((STAT & 0x10) != 0) MEM(IF_REG) |= 0x02; // request STAT interrupt
                     // Request V-Blank interrupt
-                    memory[IF_REG] |= 0x1; // Interrupt flag
+                    MEM(IF_REG) |= 0x1; // Interrupt flag
                 } else {
                     ppu_set_mode(ppu, MODE_2_OAM_SCAN);
                     ppu_oam_scan(ppu);
                     // check if in STAT an interrupt for this event has to be requested
-                    if((STAT & 0x20) != 0) memory[IF_REG] |= 0x02; // request STAT interrupt
+                    if((STAT & 0x20) != 0) MEM(IF_REG) |= 0x02; // request STAT interrupt
                 }
             }
             break;
@@ -315,15 +315,15 @@ void ppu_step(PPU *ppu, int cycles){
             if (ppu->cycle_counter >= 456) { // One scanline worth of time
                 ppu->cycle_counter -= 456;
                 ppu->ly++;
-                memory[0xFF44] = ppu->ly;
+                MEM(0xFF44) = ppu->ly;
 
                 if (ppu->ly > 153) {
                     ppu->ly = 0;
-                    memory[0xFF44] = 0;
+                    MEM(0xFF44) = 0;
                     ppu_set_mode(ppu, MODE_2_OAM_SCAN);
                     ppu_oam_scan(ppu);
                     // check if in STAT an interrupt for this event has to be requested
-                    if((STAT & 0x20) != 0) memory[IF_REG] |= 0x02; // request STAT interrupt
+                    if((STAT & 0x20) != 0) MEM(IF_REG) |= 0x02; // request STAT interrupt
                 }
             }
             break;
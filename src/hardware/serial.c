@@ -0,0 +1,141 @@
+#include "serial.h"
+#include "memory.h"
+
+SERIAL serial = {0};
+
+
+/* This function handles a write to SC. Setting bit 7 with the internal clock
+   (bit 0) starts a transfer that shifts one bit every SERIAL_CYCLES_PER_BIT,
+   with the external clock the transfer waits for the other side. */
+void serial_write_control(uint8_t data){
+    if((data & 0x81) == 0x81){
+        serial.active     = true;
+        serial.bits_left  = 8;
+        serial.bit_cycles = 0;
+    }
+    else{
+        serial.active = false;
+    }
+    serial.held = false;
+}
+
+
+
+/* This function updates the serial port if a transfer is in progress. After
+   the 8th bit the byte is exchanged through the backend and, once the backend
+   has the byte of the other side, the serial interrupt is requested. While a
+   transfer on the external clock waits the backend is given the chance to 
+   deliver a byte. */
+void serial_step(int cycles){
+    SERIAL_BACKEND *backend = serial.backend;
+
+    if(!serial.active){
+        if(backend != NULL && backend->listen != NULL && (MEM(SC_REG) & 0x81) == 0x80){
+            backend->listen(backend->ctx);
+        }
+        return;
+    }
+
+    int in = 0xFF; // nothing connected, the line stays high
+    if(serial.held){
+        in = backend->reply(backend->ctx);
+    }
+    else{
+        serial.bit_cycles += cycles;
+        while(serial.bit_cycles >= SERIAL_CYCLES_PER_BIT && serial.bits_left > 0){
+            serial.bit_cycles -= SERIAL_CYCLES_PER_BIT;
+            serial.bits_left--;
+        }
+        if(serial.bits_left > 0) return;
+
+        if(backend != NULL) in = backend->exchange(backend->ctx, MEM(SB_REG));
+    }
+    serial.held = in == SERIAL_PENDING;
+    if(serial.held) return;
+
+    MEM(SB_REG)  = in;
+    MEM(SC_REG) &= ~0x80;
+    MEM(IF_REG) |= 0x08; // Request serial interrupt
+    serial.active = false;
+}
+
+
+
+/* This function delivers a byte clocked by the other side of the cable into
+   the RAM passed (ram[0] is 0x8000). If a transfer on the external clock is waiting the
+   byte replaces SB and the serial interrupt is requested. Returns the byte
+   shifted out, 0xFF if the port was not ready. */
+uint8_t serial_receive(uint8_t *peer_ram, uint8_t in){
+    if((RAM_BYTE(peer_ram, SC_REG) & 0x81) != 0x80) return 0xFF;
+
+    uint8_t out = RAM_BYTE(peer_ram, SB_REG);
+    RAM_BYTE(peer_ram, SB_REG)  = in;
+    RAM_BYTE(peer_ram, SC_REG) &= ~0x80;
+    RAM_BYTE(peer_ram, IF_REG) |= 0x08;
+    return out;
+}
+
+
+
+/* ---- CAPTURE BACKEND ---- */
+static void capture_flush(void *ctx){
+    SERIAL_CAPTURE *capture = ctx;
+    if(capture->file == NULL || capture->len == 0) return;
+    fwrite(capture->buf, 1, capture->len, capture->file);
+    fflush(capture->file);
+    capture->len = 0;
+}
+
+static int capture_exchange(void *ctx, uint8_t out){
+    SERIAL_CAPTURE *capture = ctx;
+    if(capture->len == SERIAL_CAPTURE_SIZE){
+        if(capture->file == NULL) return 0xFF; // memory only capture is full, keep the first bytes
+        capture_flush(capture);
+    }
+    capture->buf[capture->len++] = out;
+    return 0xFF;
+}
+
+void serial_capture_init(SERIAL_BACKEND *backend, SERIAL_CAPTURE *capture, FILE *file){
+    capture->len  = 0;
+    capture->file = file;
+    backend->exchange = capture_exchange;
+    backend->reply    = NULL;
+    backend->listen   = NULL;
+    backend->flush    = capture_flush;
+    backend->ctx      = capture;
+}
+
+
+
+/* ---- LOOPBACK BACKEND ---- */
+static int loopback_exchange(void *ctx, uint8_t out){
+    return out;
+}
+
+void serial_loopback_init(SERIAL_BACKEND *backend){
+    backend->exchange = loopback_exchange;
+    backend->reply    = NULL;
+    backend->listen   = NULL;
+    backend->flush    = NULL;
+    backend->ctx      = NULL;
+}
+
+
+
+/* ---- IN-PROCESS LINK BACKEND ---- */
+/* Both emulators run in lockstep (see emulator_run_linked) so the peer state is
+   at most one quantum away from this side when the byte is exchanged */
+static int link_exchange(void *ctx, uint8_t out){
+    SERIAL_LINK *link = ctx;
+    return serial_receive(link->peer_ram, out);
+}
+
+void serial_link_init(SERIAL_BACKEND *backend, SERIAL_LINK *link, uint8_t *peer_ram){
+    link->peer_ram = peer_ram;
+    backend->exchange = link_exchange;
+    backend->reply    = NULL;
+    backend->listen   = NULL;
+    backend->flush    = NULL;
+    backend->ctx      = link;
+}
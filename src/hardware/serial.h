@@ -0,0 +1,64 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SB_REG 0xFF01 // Serial transfer data register
+#define SC_REG 0xFF02 // Serial transfer control register
+
+#define SERIAL_CYCLES_PER_BIT 512 // internal clock is 8192 Hz
+#define SERIAL_CAPTURE_SIZE 4096
+#define SERIAL_PENDING -1         // the other side has not answered yet
+
+/* A serial backend is what is connected to the link port. exchange is called
+   when a transfer driven by the internal clock completes, it receives the byte
+   shifted out and returns the byte shifted in. A backend that cannot answer at
+   once returns SERIAL_PENDING, the transfer is then held and reply is called
+   at every step until it returns the byte. listen is called at every step 
+   while a transfer on the external clock waits, so a backend can deliver a 
+   byte clocked by the other side with serial_receive. reply, listen and flush
+   can be NULL. */
+typedef struct SERIAL_BACKEND {
+    int (*exchange)(void *ctx, uint8_t out);
+    int (*reply)(void *ctx);
+    void (*listen)(void *ctx);
+    void (*flush)(void *ctx);
+    void *ctx;
+} SERIAL_BACKEND;
+
+/* Definition of serial port state machine */
+typedef struct SERIAL {
+    bool active;        // a transfer on the internal clock is in progress
+    bool held;          // its byte was shifted out, waiting for the backend to reply
+    uint8_t bits_left;
+    uint32_t bit_cycles; // cycles elapsed in the current bit
+    SERIAL_BACKEND *backend;
+} SERIAL;
+
+/* Buffered capture of the bytes sent, written to file when the buffer is full 
+   or flushed. With file NULL the bytes are only kept in memory. */
+typedef struct SERIAL_CAPTURE {
+    uint8_t buf[SERIAL_CAPTURE_SIZE];
+    size_t len;
+    FILE *file;
+} SERIAL_CAPTURE;
+
+/* One end of an in-process link cable, peer_ram is the RAM of
+   the emulator at the other end */
+typedef struct SERIAL_LINK {
+    uint8_t *peer_ram; // ram of the peer, 0x8000 first
+} SERIAL_LINK;
+
+extern SERIAL serial;
+
+void serial_write_control(uint8_t data);
+void serial_step(int cycles);
+uint8_t serial_receive(uint8_t *peer_ram, uint8_t in);
+
+void serial_capture_init(SERIAL_BACKEND *backend, SERIAL_CAPTURE *capture, FILE *file);
+void serial_loopback_init(SERIAL_BACKEND *backend);
+void serial_link_init(SERIAL_BACKEND *backend, SERIAL_LINK *link, uint8_t *peer_ram);
+
+#endif
@@ -11,11 +11,11 @@ void timer_step(int Tcycles){
 
     if(timer.div_cycle_counter >= (CLOCK_FREQ_HZ / DIV_INC_FREQ_HZ)){
         size_t increment = timer.div_cycle_counter / (CLOCK_FREQ_HZ / DIV_INC_FREQ_HZ);
-        memory[DIV_REG] += increment;
+        MEM(DIV_REG) += increment;
         timer.div_cycle_counter %= (CLOCK_FREQ_HZ / DIV_INC_FREQ_HZ);
     }
 
-    uint8_t TAC = memory[TAC_REG];
+    uint8_t TAC = MEM(TAC_REG);
     if((TAC & 0x04) != 0){ // Enable = 1 so increment TIMA
         size_t tima_inc_rate;
 
@@ -31,14 +31,14 @@ void timer_step(int Tcycles){
             timer.tima_cycle_counter -= threshold;
 
             // Increment TIMA by exactly 1
-            memory[TIMA_REG]++;
+            MEM(TIMA_REG)++;
 
             // If TIMA just overflowed (went from 255 to 0)
-            if (memory[TIMA_REG] == 0) {
+            if (MEM(TIMA_REG) == 0) {
                 // Load the value from TMA
-                memory[TIMA_REG] = memory[TMA_REG];
+                MEM(TIMA_REG) = MEM(TMA_REG);
                 // Request a timer interrupt
-                memory[IF_REG] |= 0x04;
+                MEM(IF_REG) |= 0x04;
             }
         }
     }
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+/* Body of the writer thread, it empties the ring before leaving */
+static void *trace_thread(void *arg){
+    TRACER *t = arg;
+
+    while(true){
+        uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        if(tail == head){
+            if(atomic_load(&t->stop)) break;
+
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            uint64_t nsec = until.tv_nsec + TRACE_IDLE_NS;
+            until.tv_sec += nsec / 1000000000ULL;
+            until.tv_nsec = nsec % 1000000000ULL;
+
+            pthread_mutex_lock(&t->lock);
+            if(tail == atomic_load(&t->head) && !atomic_load(&t->stop)){
+                pthread_cond_timedwait(&t->wake, &t->lock, &until);
+            }
+            pthread_mutex_unlock(&t->lock);
+            continue;
+        }
+
+        // up to the end of the ring, the rest goes in the next round
+        uint64_t start = tail & (TRACE_RING_SIZE - 1);
+        uint64_t count = head - tail;
+        if(start + count > TRACE_RING_SIZE) count = TRACE_RING_SIZE - start;
+
+        if(!t->failed && fwrite(&t->ring[start], sizeof(TRACE_RECORD), count, t->out) != count){
+            fprintf(stderr, "[ERROR] Cannot write the trace to %s\n", t->path);
+            t->failed = true;
+        }
+        t->written += count;
+        atomic_store_explicit(&t->tail, tail + count, memory_order_release);
+    }
+    return NULL;
+}
+
+
+
+static void wake_writer(TRACER *t){
+    if(pthread_mutex_trylock(&t->lock) == 0){
+        pthread_cond_signal(&t->wake);
+        pthread_mutex_unlock(&t->lock);
+    }
+}
+
+
+
+/* This function sets a filter that records every instruction */
+void trace_filter_init(TRACE_FILTER *filter){
+    memset(filter, 0, sizeof(TRACE_FILTER));
+    filter->pc_max = 0xFFFF;
+    filter->cycle_max = UINT64_MAX;
+}
+
+
+
+/* This function parses "START-END" in the base passed, a missing bound is
+   open ("-END", "START-"). Returns false if s is not a range. */
+bool trace_parse_range(const char *s, int base, uint64_t *min, uint64_t *max){
+    char *end;
+    const char *dash = strchr(s, '-');
+    if(dash == NULL) return false;
+    if(dash != s){
+        *min = strtoull(s, &end, base);
+        if(end != dash) return false;
+    }
+    if(dash[1] != '\0'){
+        *max = strtoull(dash + 1, &end, base);
+        if(*end != '\0') return false;
+    }
+    return *min <= *max;
+}
+
+
+
+/* This function parses a trigger, "pc:ADDR" or "mem:ADDR=VALUE" in hex */
+bool trace_parse_trigger(const char *s, TRACE_FILTER *filter){
+    char *end;
+    if(strncmp(s, "pc:", 3) == 0){
+        unsigned long addr = strtoul(s + 3, &end, 16);
+        if(end == s + 3 || *end != '\0' || addr > 0xFFFF) return false;
+        filter->trigger = TRACE_TRIGGER_PC;
+        filter->trigger_addr = addr;
+        return true;
+    }
+    if(strncmp(s, "mem:", 4) == 0){
+        unsigned long addr = strtoul(s + 4, &end, 16);
+        if(end == s + 4 || *end != '=' || addr > 0xFFFF) return false;
+        const char *value_start = end + 1;
+        unsigned long value = strtoul(value_start, &end, 16);
+        if(end == value_start || *end != '\0' || value > 0xFF) return false;
+        filter->trigger = TRACE_TRIGGER_MEM;
+        filter->trigger_addr = addr;
+        filter->trigger_value = value;
+        return true;
+    }
+    return false;
+}
+
+
+
+/* This function creates the trace file at path and starts the writer thread,
+   recording what the filter passes. Returns false if the file or the thread
+   cannot be created. */
+bool trace_open(TRACER *t, const char *path, const TRACE_FILTER *filter){
+    memset(t, 0, sizeof(TRACER));
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->stop, false);
+
+    snprintf(t->path, sizeof(t->path), "%s", path);
+    t->out = fopen(path, "wb");
+    if(t->out == NULL) return false;
+
+    TRACE_HEADER header = { TRACE_MAGIC, TRACE_VERSION, sizeof(TRACE_RECORD) };
+    fwrite(&header, sizeof(header), 1, t->out);
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wake, NULL);
+    if(pthread_create(&t->thread, NULL, trace_thread, t) != 0){
+        pthread_cond_destroy(&t->wake);
+        pthread_mutex_destroy(&t->lock);
+        fclose(t->out);
+        t->out = NULL;
+        return false;
+    }
+    t->filter = *filter;
+    t->triggered = filter->trigger == TRACE_TRIGGER_NONE;
+    t->enabled = true;
+    t->active = true;
+    return true;
+}
+
+
+
+/* Returns the next free record of the ring, waiting for the writer when it is full */
+static TRACE_RECORD *claim_record(TRACER *t){
+    uint64_t next = t->next;
+    if(next - t->tail_seen == TRACE_RING_SIZE){
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        while(next - t->tail_seen == TRACE_RING_SIZE){
+            t->waits++;
+            wake_writer(t);
+            sched_yield();
+            t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        }
+    }
+    return &t->ring[next & (TRACE_RING_SIZE - 1)];
+}
+
+static void commit_record(TRACER *t){
+    uint64_t next = ++t->next;
+    if((next & (TRACE_PUBLISH_EVERY - 1)) == 0) atomic_store_explicit(&t->head, next, memory_order_release);
+}
+
+
+
+/* This function adds the state of the CPU about to execute the instruction at
+   PC, mem holds the 4 bytes from PC. Called on the emulation thread for every
+   step, the ring is only touched by the writer once a batch is published. */
+void trace_record(TRACER *t, const CPU *cpu, const uint8_t mem[4]){
+    uint64_t distance = t->cycle - t->last_cycle; // the steps take whole M-cycles
+    uint8_t delta = TRACE_AT_MARKER;
+    if(t->recorded > 0 && distance % 4 == 0 && distance >= 4 && distance / 4 <= TRACE_DELTA_MAX){
+        delta = distance / 4;
+    }
+    else{
+        TRACE_RECORD *marker = claim_record(t);
+        *marker = (TRACE_RECORD){
+            .af = TRACE_MARKER,
+            .bc = t->cycle,       .de = t->cycle >> 16,
+            .hl = t->cycle >> 32, .sp = t->cycle >> 48
+        };
+        commit_record(t);
+    }
+
+    TRACE_RECORD *r = claim_record(t);
+    r->pc = cpu->PC;
+    r->sp = cpu->SP;
+    r->af = (cpu->AF & 0xFFF0) | delta;
+    r->bc = cpu->BC;
+    r->de = cpu->DE;
+    r->hl = cpu->HL;
+    memcpy(r->mem, mem, 4);
+    commit_record(t);
+
+    t->recorded++;
+    t->last_cycle = t->cycle;
+}
+
+
+
+/* This function publishes the last records, waits for the writer to write
+   all of them and closes the file */
+void trace_close(TRACER *t){
+    if(!t->active) return;
+
+    atomic_store_explicit(&t->head, t->next, memory_order_release);
+    atomic_store(&t->stop, true);
+    pthread_mutex_lock(&t->lock);
+    pthread_cond_signal(&t->wake);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_cond_destroy(&t->wake);
+    pthread_mutex_destroy(&t->lock);
+    t->active = false;
+    t->enabled = false;
+
+    if(fclose(t->out) != 0 && !t->failed){
+        fprintf(stderr, "[ERROR] Cannot write the trace to %s\n", t->path);
+        t->failed = true;
+    }
+    t->out = NULL;
+}
+
+
+
+void trace_print_stats(const TRACER *t, FILE *out){
+    fprintf(out, "[STATS] trace: %llu records (%.1f MB) written to %s, the emulation waited for the writer %llu times\n",
+            (unsigned long long)t->written, t->written * sizeof(TRACE_RECORD) / 1e6, t->path, (unsigned long long)t->waits);
+}
+
+
+
+/* This function reads the header of a trace file, returns false if the file
+   is not a trace this build can read */
+bool trace_read_header(FILE *in){
+    TRACE_HEADER header;
+    return fread(&header, sizeof(header), 1, in) == 1 && header.magic == TRACE_MAGIC &&
+           header.version == TRACE_VERSION && header.record_size == sizeof(TRACE_RECORD);
+}
+
+
+
+/* Bank of the instruction of the record, 0 for the fixed ROM bank and the
+   rest of the address space, 1 for the switchable one */
+uint8_t trace_bank(const TRACE_RECORD *r){
+    return r->pc >= 0x4000 && r->pc < 0x8000 ? 1 : 0;
+}
+
+
+
+/* This function follows the cycle along the records read in order: a marker
+   sets it, an instruction moves it by its delta. Returns false for a marker,
+   it is not an instruction. */
+bool trace_cycle(const TRACE_RECORD *r, uint64_t *cycle){
+    uint8_t delta = r->af & TRACE_DELTA_MASK;
+    if(delta == TRACE_MARKER){
+        *cycle = (uint64_t)r->sp << 48 | (uint64_t)r->hl << 32 | (uint64_t)r->de << 16 | r->bc;
+        return false;
+    }
+    if(delta != TRACE_AT_MARKER) *cycle += delta * 4;
+    return true;
+}
+
+
+
+/* This function writes the record as a line of the gameboy-doctor log,
+   newline included. Returns the length as snprintf does. */
+int trace_format_doctor(const TRACE_RECORD *r, char *buf, size_t len){
+    return snprintf(buf, len, "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
+                    r->af >> 8, r->af & 0xF0, r->bc >> 8, r->bc & 0xFF, r->de >> 8, r->de & 0xFF, r->hl >> 8, r->hl & 0xFF,
+                    r->sp, r->pc, r->mem[0], r->mem[1], r->mem[2], r->mem[3]);
+}
@@ -0,0 +1,115 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "cpu.h"
+
+#define TRACE_RING_SIZE     (1 << 17) // records, must be a power of 2, 2 MB
+#define TRACE_PUBLISH_EVERY 256       // records made visible to the writer at once, a power of 2
+#define TRACE_IDLE_NS       1000000   // the writer looks at the ring at least this often
+#define TRACE_PATH_MAX      256
+
+#define TRACE_MAGIC   0x52544247 // "GBTR"
+#define TRACE_VERSION 2
+
+#define TRACE_DELTA_MASK 0x0F // of F, where the records keep their cycle
+#define TRACE_DELTA_MAX  14   // M-cycles, a longer distance needs a marker
+#define TRACE_MARKER     0x00 // the record carries the cycle of the next one
+#define TRACE_AT_MARKER  0x0F // the instruction starts at the cycle of the marker before it
+
+/* Header of a trace file, followed by the records */
+typedef struct TRACE_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} TRACE_HEADER;
+
+/* State of the CPU before an instruction, 16 bytes. The low nibble of F is
+   always 0 on the SM83 so it holds the M-cycles since the instruction 
+   recorded before, 1 to TRACE_DELTA_MAX, instead. When the distance does not fit, at the first
+   record and after the instructions left out by a filter or a pause, a 
+   marker record with TRACE_MARKER there comes first. It carries the cycle of
+   the instruction in bc, de, hl and sp, lowest bits first, counted from when
+   the trace was attached as --trace-cycles does (trace_cycle). The cartridges
+   have no bank switching so the bank follows from PC (trace_bank). */
+typedef struct TRACE_RECORD {
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t af;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint8_t  mem[4]; // bytes at PC, the opcode and its operands
+} TRACE_RECORD;
+
+_Static_assert(sizeof(TRACE_RECORD) == 16, "trace records are 16 bytes");
+
+typedef enum TRACE_TRIGGER {
+    TRACE_TRIGGER_NONE,
+    TRACE_TRIGGER_PC,  // PC reaches trigger_addr
+    TRACE_TRIGGER_MEM  // the byte at trigger_addr equals trigger_value
+} TRACE_TRIGGER;
+
+/* Which instructions are recorded. Nothing is recorded before the trigger
+   fires, after it only the instructions inside both ranges. */
+typedef struct TRACE_FILTER {
+    uint16_t pc_min, pc_max;
+    uint64_t cycle_min, cycle_max; // cycles since the trace was attached, at power on from the command line
+    TRACE_TRIGGER trigger;
+    uint16_t trigger_addr;
+    uint8_t trigger_value;
+    uint64_t limit;                // records after which the trace stops, 0 for no limit
+} TRACE_FILTER;
+
+/* Definition of the execution trace. The emulation thread writes the records
+   in a ring without locks and makes them visible in batches, the writer thread
+   drains them to the file. A full ring makes the emulation wait: a trace with
+   holes would be useless to compare. */
+typedef struct TRACER {
+    TRACE_RECORD ring[TRACE_RING_SIZE];
+    _Alignas(64) _Atomic uint64_t head; // records published by the emulation thread
+    _Alignas(64) _Atomic uint64_t tail; // records written by the writer thread
+    atomic_bool stop;
+
+    // emulation thread
+    _Alignas(64) bool active;
+    bool enabled;         // recording, it can be paused while the trace is attached
+    bool triggered;
+    TRACE_FILTER filter;
+    uint64_t cycle;       // cycles run by the traced emulator
+    uint64_t next;        // next record to fill, published up to head
+    uint64_t tail_seen;   // last tail read, refreshed only when the ring looks full
+    uint64_t recorded;    // instructions recorded, markers left out
+    uint64_t last_cycle;  // cycle of the last one
+    uint64_t waits;       // times the ring was full
+
+    // writer thread
+    pthread_t thread;
+    pthread_mutex_t lock; // only to sleep on wake
+    pthread_cond_t wake;
+    FILE *out;
+    char path[TRACE_PATH_MAX];
+    uint64_t written;
+    bool failed;
+} TRACER;
+
+void trace_filter_init(TRACE_FILTER *filter);
+bool trace_parse_range(const char *s, int base, uint64_t *min, uint64_t *max);
+bool trace_parse_trigger(const char *s, TRACE_FILTER *filter);
+
+bool trace_open(TRACER *t, const char *path, const TRACE_FILTER *filter);
+void trace_record(TRACER *t, const CPU *cpu, const uint8_t mem[4]);
+void trace_close(TRACER *t);
+void trace_print_stats(const TRACER *t, FILE *out);
+
+bool trace_read_header(FILE *in);
+uint8_t trace_bank(const TRACE_RECORD *r);
+bool trace_cycle(const TRACE_RECORD *r, uint64_t *cycle);
+int trace_format_doctor(const TRACE_RECORD *r, char *buf, size_t len);
+
+#endif
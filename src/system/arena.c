@@ -0,0 +1,64 @@
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+
+/* This function maps the memory for count instances, they are left zeroed
+   and have to be prepared with emulator_init. With hugepages the mapping is
+   first tried on reserved huge pages, then transparent huge pages are 
+   requested, the arena falls back to small pages where neither exists. 
+   Returns false if the memory cannot be mapped. */
+bool arena_create(EMULATOR_ARENA *arena, size_t count, bool hugepages){
+    memset(arena, 0, sizeof(EMULATOR_ARENA));
+    size_t length = count * sizeof(EMULATOR);
+    void *base = MAP_FAILED;
+
+    if(hugepages){
+        length = (length + ARENA_HUGEPAGE_SIZE - 1) & ~(size_t)(ARENA_HUGEPAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(base != MAP_FAILED) arena->pages = ARENA_HUGETLB;
+#endif
+    }
+
+    if(base == MAP_FAILED){
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) return false;
+#ifdef MADV_HUGEPAGE
+        if(hugepages && madvise(base, length, MADV_HUGEPAGE) == 0) arena->pages = ARENA_TRANSPARENT_HUGEPAGES;
+#endif
+    }
+
+    // mappings start on a page so every instance keeps the alignment of EMULATOR
+    arena->emulators = base;
+    arena->count     = count;
+    arena->length    = length;
+    return true;
+}
+
+
+
+void arena_destroy(EMULATOR_ARENA *arena){
+    if(arena->emulators == NULL) return;
+
+    for(size_t i = 0; i < arena->count; i++){
+        if(bound_emulator == &arena->emulators[i]) bound_emulator = NULL; // nothing to save back into an unmapped instance
+    }
+    munmap(arena->emulators, arena->length);
+    arena->emulators = NULL;
+}
+
+
+
+const char *arena_pages_name(ARENA_PAGES pages){
+    switch(pages){
+        case ARENA_HUGETLB:               return "hugetlb pages";
+        case ARENA_TRANSPARENT_HUGEPAGES: return "transparent huge pages";
+        default:                          return "small pages";
+    }
+}
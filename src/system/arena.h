@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../hardware/emulator.h"
+
+#define ARENA_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef enum ARENA_PAGES {
+    ARENA_SMALL_PAGES,
+    ARENA_TRANSPARENT_HUGEPAGES, // the kernel was asked to back it with huge pages when it can
+    ARENA_HUGETLB                // reserved huge pages
+} ARENA_PAGES;
+
+/* Contiguous array of emulator instances for batch runs. Instances are 
+   cache line aligned and never share a line, with huge pages thousands of 
+   instances are covered by a few TLB entries. */
+typedef struct EMULATOR_ARENA {
+    EMULATOR *emulators;
+    size_t count;
+    size_t length; // bytes mapped
+    ARENA_PAGES pages;
+} EMULATOR_ARENA;
+
+bool arena_create(EMULATOR_ARENA *arena, size_t count, bool hugepages);
+void arena_destroy(EMULATOR_ARENA *arena);
+const char *arena_pages_name(ARENA_PAGES pages);
+
+#endif
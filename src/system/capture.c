@@ -0,0 +1,387 @@
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "pacing.h"
+
+#define CAPTURE_IDLE_NS 10000000 // longest sleep of the encoder when a wake up is missed
+
+static const uint8_t capture_shades[4] = { 0xFF, 0xC0, 0x2C, 0x00 }; // same gray levels as the window
+
+
+/* This function packs a frame of shades 0-3 to 2 bits per pixel, first pixel
+   in the high bits of a byte */
+void capture_pack(const uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH], uint8_t packed[CAPTURE_FRAME_BYTES]){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint8_t *row = pixels[y];
+        uint8_t *out = &packed[y * CAPTURE_ROW_BYTES];
+        for(int x = 0; x < WINDOW_WIDTH; x += 4){
+            *out++ = (row[x] << 6) | (row[x + 1] << 4) | (row[x + 2] << 2) | row[x + 3];
+        }
+    }
+}
+
+
+
+/* This function compresses len bytes with PackBits: a header byte n below 128
+   is followed by n + 1 literal bytes, above 128 by one byte repeated 257 - n
+   times. Returns the compressed size, at most CAPTURE_RLE_MAX for a frame. */
+size_t capture_rle_encode(const uint8_t *in, size_t len, uint8_t *out){
+    size_t i = 0, o = 0;
+    while(i < len){
+        size_t run = 1;
+        while(i + run < len && run < 128 && in[i + run] == in[i]) run++;
+        if(run >= 2){
+            out[o++] = (uint8_t)(257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        // literals until a run of 3, shorter runs cost as much as literals
+        size_t start = i, n = 0;
+        while(i < len && n < 128){
+            if(i + 2 < len && in[i] == in[i + 1] && in[i] == in[i + 2]) break;
+            i++;
+            n++;
+        }
+        out[o++] = (uint8_t)(n - 1);
+        memcpy(&out[o], &in[start], n);
+        o += n;
+    }
+    return o;
+}
+
+
+
+/* This function expands PackBits data, it returns false unless it fills
+   exactly out_len bytes */
+bool capture_rle_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len){
+    size_t i = 0, o = 0;
+    while(i < len){
+        uint8_t header = in[i++];
+        if(header < 128){
+            size_t n = header + 1;
+            if(i + n > len || o + n > out_len) return false;
+            memcpy(&out[o], &in[i], n);
+            i += n;
+            o += n;
+        }
+        else if(header > 128){
+            size_t n = 257 - header;
+            if(i >= len || o + n > out_len) return false;
+            memset(&out[o], in[i++], n);
+            o += n;
+        }
+    }
+    return o == out_len;
+}
+
+
+
+static uint32_t png_crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const uint8_t *data, size_t len){
+    if(png_crc_table[1] == 0){
+        for(uint32_t n = 0; n < 256; n++){
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            png_crc_table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for(size_t i = 0; i < len; i++) crc = png_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t value){
+    p[0] = value >> 24; p[1] = value >> 16; p[2] = value >> 8; p[3] = value;
+    return p + 4;
+}
+
+/* Writes a PNG chunk, type and data are covered by the CRC */
+static bool png_chunk(FILE *out, const char *type, const uint8_t *data, uint32_t len){
+    uint8_t header[8], trailer[4];
+    put_be32(header, len);
+    memcpy(&header[4], type, 4);
+    uint32_t crc = png_crc(png_crc(0, &header[4], 4), data, len);
+    put_be32(trailer, crc);
+    return fwrite(header, 8, 1, out) == 1 && (len == 0 || fwrite(data, len, 1, out) == 1) &&
+           fwrite(trailer, 4, 1, out) == 1;
+}
+
+
+
+/* This function writes a packed frame as a 2 bit palette PNG. The rows are
+   already in PNG layout and fit a single stored deflate block, so there is
+   no need for zlib: about 6 KB per screenshot. */
+bool capture_write_png(const char *path, const uint8_t packed[CAPTURE_FRAME_BYTES]){
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    enum { RAW_BYTES = WINDOW_HEIGHT * (CAPTURE_ROW_BYTES + 1) }; // a filter byte before each row
+
+    uint8_t ihdr[13];
+    put_be32(put_be32(ihdr, WINDOW_WIDTH), WINDOW_HEIGHT);
+    ihdr[8] = 2;  // bits per pixel
+    ihdr[9] = 3;  // palette
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    uint8_t plte[12];
+    for(int i = 0; i < 4; i++) plte[3 * i] = plte[3 * i + 1] = plte[3 * i + 2] = capture_shades[i];
+
+    // zlib header, one final stored block, adler32 of the raw data
+    static uint8_t idat[2 + 5 + RAW_BYTES + 4];
+    uint8_t *raw = &idat[7];
+    uint32_t a = 1, b = 0;
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        uint8_t *row = &raw[y * (CAPTURE_ROW_BYTES + 1)];
+        row[0] = 0; // no filter
+        memcpy(&row[1], &packed[y * CAPTURE_ROW_BYTES], CAPTURE_ROW_BYTES);
+        for(int i = 0; i <= CAPTURE_ROW_BYTES; i++){
+            a = (a + row[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    idat[0] = 0x78; idat[1] = 0x01;
+    idat[2] = 1;    // final block, stored
+    idat[3] = RAW_BYTES & 0xFF; idat[4] = RAW_BYTES >> 8;
+    idat[5] = ~RAW_BYTES & 0xFF; idat[6] = (~RAW_BYTES >> 8) & 0xFF;
+    put_be32(&raw[RAW_BYTES], (b << 16) | a);
+
+    FILE *out = fopen(path, "wb");
+    if(out == NULL) return false;
+    bool ok = fwrite(signature, 8, 1, out) == 1 &&
+              png_chunk(out, "IHDR", ihdr, sizeof(ihdr)) &&
+              png_chunk(out, "PLTE", plte, sizeof(plte)) &&
+              png_chunk(out, "IDAT", idat, sizeof(idat)) &&
+              png_chunk(out, "IEND", NULL, 0);
+    return fclose(out) == 0 && ok;
+}
+
+
+
+/* This function writes the stream header of a Y4M file: native size and
+   frame rate, monochrome */
+void capture_write_y4m_header(FILE *out){
+    fprintf(out, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 Cmono\n", WINDOW_WIDTH, WINDOW_HEIGHT, CAPTURE_RATE_NUM, CAPTURE_RATE_DEN);
+}
+
+
+
+/* This function writes a packed frame to a Y4M stream as 8 bit luma */
+void capture_write_y4m_frame(FILE *out, const uint8_t packed[CAPTURE_FRAME_BYTES]){
+    uint8_t luma[WINDOW_WIDTH * WINDOW_HEIGHT];
+    for(int i = 0; i < CAPTURE_FRAME_BYTES; i++){
+        luma[4 * i]     = capture_shades[packed[i] >> 6];
+        luma[4 * i + 1] = capture_shades[(packed[i] >> 4) & 3];
+        luma[4 * i + 2] = capture_shades[(packed[i] >> 2) & 3];
+        luma[4 * i + 3] = capture_shades[packed[i] & 3];
+    }
+    fputs("FRAME\n", out);
+    fwrite(luma, sizeof(luma), 1, out);
+}
+
+
+
+/* Writes a frame to the video stream, on the encoder thread */
+static void encode_frame(CAPTURE *cap, const CAPTURE_FRAME *slot){
+    if(cap->format == CAPTURE_Y4M){
+        // a Y4M stream has no timestamps, the last frame stands in for the dropped ones
+        for(uint64_t f = cap->last_frame + 1; cap->encoded > 0 && f < slot->frame; f++){
+            capture_write_y4m_frame(cap->out, cap->previous);
+            cap->repeated++;
+        }
+        capture_write_y4m_frame(cap->out, slot->packed);
+        cap->bytes += 6 + WINDOW_WIDTH * WINDOW_HEIGHT;
+    }
+    else{
+        bool key = cap->encoded % CAPTURE_GBV_KEYFRAME_INTERVAL == 0;
+        uint8_t delta[CAPTURE_FRAME_BYTES];
+        const uint8_t *data = slot->packed;
+        if(!key){
+            for(int i = 0; i < CAPTURE_FRAME_BYTES; i++) delta[i] = slot->packed[i] ^ cap->previous[i];
+            data = delta;
+        }
+
+        CAPTURE_GBV_FRAME header = {
+            .frame  = (uint32_t)slot->frame,
+            .flags  = key ? CAPTURE_GBV_KEY : 0,
+            .length = (uint32_t)capture_rle_encode(data, CAPTURE_FRAME_BYTES, cap->rle)
+        };
+        fwrite(&header, sizeof(header), 1, cap->out);
+        fwrite(cap->rle, header.length, 1, cap->out);
+        cap->bytes += sizeof(header) + header.length;
+    }
+
+    memcpy(cap->previous, slot->packed, CAPTURE_FRAME_BYTES);
+    cap->last_frame = slot->frame;
+    cap->encoded++;
+    if(ferror(cap->out) && !cap->failed){
+        fprintf(stderr, "[ERROR] Cannot write the capture to %s, recording stopped\n", cap->path);
+        cap->failed = true;
+    }
+}
+
+
+
+/* Body of the encoder thread, it empties the queue before leaving */
+static void *capture_thread(void *arg){
+    CAPTURE *cap = arg;
+
+    while(true){
+        uint64_t tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+        if(tail == atomic_load_explicit(&cap->head, memory_order_acquire)){
+            if(atomic_load(&cap->stop)) break;
+
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            uint64_t nsec = until.tv_nsec + CAPTURE_IDLE_NS;
+            until.tv_sec += nsec / 1000000000ULL;
+            until.tv_nsec = nsec % 1000000000ULL;
+
+            pthread_mutex_lock(&cap->lock);
+            if(tail == atomic_load(&cap->head) && !atomic_load(&cap->stop)){
+                pthread_cond_timedwait(&cap->wake, &cap->lock, &until);
+            }
+            pthread_mutex_unlock(&cap->lock);
+            continue;
+        }
+
+        const CAPTURE_FRAME *slot = &cap->queue[tail & (CAPTURE_QUEUE_SIZE - 1)];
+        uint64_t start = pacer_now_ns();
+        if(slot->flags & CAPTURE_SCREENSHOT){
+            if(capture_write_png(slot->screenshot_path, slot->packed)){
+                printf("[INFO] Screenshot of frame %llu saved to %s\n", (unsigned long long)slot->frame, slot->screenshot_path);
+                cap->screenshots++;
+            }
+            else fprintf(stderr, "[ERROR] Cannot write screenshot %s\n", slot->screenshot_path);
+        }
+        if((slot->flags & CAPTURE_RECORD) && !cap->failed) encode_frame(cap, slot);
+        cap->encode_ns += pacer_now_ns() - start;
+
+        atomic_store_explicit(&cap->tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+
+
+/* This function starts the capture pipeline. With a record_path every frame
+   is recorded there, as Y4M when it ends in .y4m and as .gbv otherwise; with
+   NULL only screenshots are taken. Returns false if the file or the thread
+   cannot be created. */
+bool capture_open(CAPTURE *cap, const char *record_path){
+    memset(cap, 0, sizeof(CAPTURE));
+    atomic_init(&cap->head, 0);
+    atomic_init(&cap->tail, 0);
+    atomic_init(&cap->stop, false);
+
+    if(record_path != NULL){
+        size_t len = strlen(record_path);
+        cap->format = (len >= 4 && strcmp(record_path + len - 4, ".y4m") == 0) ? CAPTURE_Y4M : CAPTURE_GBV;
+        snprintf(cap->path, sizeof(cap->path), "%s", record_path);
+        cap->out = fopen(record_path, "wb");
+        if(cap->out == NULL) return false;
+
+        if(cap->format == CAPTURE_Y4M) capture_write_y4m_header(cap->out);
+        else{
+            CAPTURE_GBV_HEADER header = {
+                .magic = CAPTURE_GBV_MAGIC, .version = CAPTURE_GBV_VERSION,
+                .keyframe_interval = CAPTURE_GBV_KEYFRAME_INTERVAL,
+                .width = WINDOW_WIDTH, .height = WINDOW_HEIGHT,
+                .rate_num = CAPTURE_RATE_NUM, .rate_den = CAPTURE_RATE_DEN
+            };
+            fwrite(&header, sizeof(header), 1, cap->out);
+        }
+        cap->recording = true;
+    }
+
+    pthread_mutex_init(&cap->lock, NULL);
+    pthread_cond_init(&cap->wake, NULL);
+    if(pthread_create(&cap->thread, NULL, capture_thread, cap) != 0){
+        pthread_cond_destroy(&cap->wake);
+        pthread_mutex_destroy(&cap->lock);
+        if(cap->out != NULL) fclose(cap->out);
+        cap->out = NULL;
+        return false;
+    }
+    cap->active = true;
+    return true;
+}
+
+
+
+/* This function asks for a PNG of the next completed frame at path. A request
+   made before the previous one was taken replaces it. */
+void capture_screenshot(CAPTURE *cap, const char *path){
+    snprintf(cap->screenshot_path, sizeof(cap->screenshot_path), "%s", path);
+}
+
+
+
+/* Frame buffer hook that collects the frame being drawn */
+void capture_pixel(CAPTURE *cap, int x, int y, uint8_t color){
+    cap->pixels[y][x] = color & 0x03;
+    cap->pixels_written++;
+}
+
+
+
+/* This function queues the frame that just ended, called once per emulated
+   frame. It never waits for the encoder: when the queue is full the frame is
+   dropped and a pending screenshot is kept for the next one. */
+void capture_frame_done(CAPTURE *cap){
+    if(!cap->active) return;
+
+    cap->frame++;
+    if(cap->pixels_written < WINDOW_WIDTH * WINDOW_HEIGHT) memset(cap->pixels, 0, sizeof(cap->pixels)); // LCD off, blank
+    cap->pixels_written = 0;
+
+    uint32_t flags = (cap->recording ? CAPTURE_RECORD : 0) | (cap->screenshot_path[0] ? CAPTURE_SCREENSHOT : 0);
+    if(flags == 0) return;
+
+    uint64_t head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&cap->tail, memory_order_acquire) == CAPTURE_QUEUE_SIZE){
+        cap->dropped++;
+        return;
+    }
+
+    CAPTURE_FRAME *slot = &cap->queue[head & (CAPTURE_QUEUE_SIZE - 1)];
+    slot->frame = cap->frame;
+    slot->flags = flags;
+    capture_pack(cap->pixels, slot->packed);
+    if(flags & CAPTURE_SCREENSHOT){
+        memcpy(slot->screenshot_path, cap->screenshot_path, CAPTURE_PATH_MAX);
+        cap->screenshot_path[0] = '\0';
+    }
+    atomic_store_explicit(&cap->head, head + 1, memory_order_release);
+
+    if(pthread_mutex_trylock(&cap->lock) == 0){
+        pthread_cond_signal(&cap->wake);
+        pthread_mutex_unlock(&cap->lock);
+    }
+}
+
+
+
+/* This function waits for the encoder to write every queued frame, then stops
+   it and closes the recording */
+void capture_close(CAPTURE *cap){
+    if(!cap->active) return;
+
+    atomic_store(&cap->stop, true);
+    pthread_mutex_lock(&cap->lock);
+    pthread_cond_signal(&cap->wake);
+    pthread_mutex_unlock(&cap->lock);
+    pthread_join(cap->thread, NULL);
+    pthread_cond_destroy(&cap->wake);
+    pthread_mutex_destroy(&cap->lock);
+    cap->active = false;
+
+    if(cap->out != NULL){
+        fclose(cap->out);
+        cap->out = NULL;
+        printf("[INFO] Recorded %llu frames to %s, %.1f KB, %llu dropped, %llu repeated, %.1f us per frame to encode\n",
+               (unsigned long long)cap->encoded, cap->path, cap->bytes / 1024.0, (unsigned long long)cap->dropped,
+               (unsigned long long)cap->repeated, cap->encoded ? cap->encode_ns / 1e3 / cap->encoded : 0.0);
+    }
+}
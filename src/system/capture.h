@@ -0,0 +1,115 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "../hardware/ppu.h"
+
+#define CAPTURE_QUEUE_SIZE  256 // frames, must be a power of 2, about 4 s of emulation
+#define CAPTURE_FRAME_BYTES (WINDOW_WIDTH * WINDOW_HEIGHT / 4) // 2 bits per pixel, 5760 bytes
+#define CAPTURE_ROW_BYTES   (WINDOW_WIDTH / 4)
+#define CAPTURE_PATH_MAX    256
+#define CAPTURE_RLE_MAX     (CAPTURE_FRAME_BYTES + CAPTURE_FRAME_BYTES / 128 + 1) // all literals
+
+#define CAPTURE_GBV_MAGIC   0x56424753 // "SGBV"
+#define CAPTURE_GBV_VERSION 1
+#define CAPTURE_GBV_KEYFRAME_INTERVAL 600 // a frame every 10 s does not depend on the previous ones
+#define CAPTURE_RATE_NUM    4194304 // frames per second as a fraction, the clock over CYCLES_PER_FRAME
+#define CAPTURE_RATE_DEN    70224
+
+/* Flags of a queued frame */
+#define CAPTURE_RECORD     1 // goes to the video stream
+#define CAPTURE_SCREENSHOT 2 // written as PNG to the path of the frame
+
+/* Flags of a frame in a .gbv file */
+#define CAPTURE_GBV_KEY 1 // RLE of the packed frame, otherwise of its XOR with the previous one
+
+typedef enum {
+    CAPTURE_Y4M, // raw monochrome YUV4MPEG2, readable by ffmpeg and most players
+    CAPTURE_GBV  // frames packed to 2 bits per pixel, XOR with the previous frame and RLE
+} CAPTURE_FORMAT;
+
+/* Header of a .gbv file, followed by the frames each with a CAPTURE_GBV_FRAME */
+typedef struct CAPTURE_GBV_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t keyframe_interval;
+    uint16_t width;
+    uint16_t height;
+    uint32_t rate_num;
+    uint32_t rate_den;
+} CAPTURE_GBV_HEADER;
+
+/* Header of a frame in a .gbv file. Frame numbers are consecutive unless
+   frames were dropped, a player shows the previous frame for the missing ones. */
+typedef struct CAPTURE_GBV_FRAME {
+    uint32_t frame;
+    uint16_t flags;
+    uint16_t reserved;
+    uint32_t length; // bytes of RLE data that follow
+} CAPTURE_GBV_FRAME;
+
+/* A completed frame in the queue, pixels packed 4 per byte with the first one
+   in the high bits, which is also the layout of a 2 bit PNG row */
+typedef struct CAPTURE_FRAME {
+    uint64_t frame;
+    uint32_t flags;
+    uint8_t packed[CAPTURE_FRAME_BYTES];
+    char screenshot_path[CAPTURE_PATH_MAX];
+} CAPTURE_FRAME;
+
+/* Definition of the capture pipeline. The emulation thread collects the PPU
+   output in pixels and queues each frame when it ends, the encoder thread
+   writes them. The queue is single producer single consumer without locks, a
+   frame that does not fit is dropped instead of slowing the emulation. */
+typedef struct CAPTURE {
+    CAPTURE_FRAME queue[CAPTURE_QUEUE_SIZE];
+    _Alignas(64) _Atomic uint64_t head; // next frame to queue, written by the emulation thread
+    _Alignas(64) _Atomic uint64_t tail; // next frame to encode, written by the encoder thread
+    atomic_bool stop;
+
+    // emulation thread
+    bool active;
+    bool recording;
+    uint64_t frame;
+    int pixels_written;
+    uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH];
+    char screenshot_path[CAPTURE_PATH_MAX]; // pending screenshot, empty when there is none
+    uint64_t dropped;
+
+    // encoder thread
+    pthread_t thread;
+    pthread_mutex_t lock; // only to sleep on wake
+    pthread_cond_t wake;
+    FILE *out;
+    char path[CAPTURE_PATH_MAX];
+    CAPTURE_FORMAT format;
+    uint8_t previous[CAPTURE_FRAME_BYTES];
+    uint8_t rle[CAPTURE_RLE_MAX];
+    uint64_t last_frame; // last frame written to the stream
+    uint64_t encoded;
+    uint64_t repeated;   // frames written again in place of dropped ones (Y4M)
+    uint64_t screenshots;
+    uint64_t bytes;
+    uint64_t encode_ns;
+    bool failed;
+} CAPTURE;
+
+bool capture_open(CAPTURE *cap, const char *record_path);
+void capture_screenshot(CAPTURE *cap, const char *path);
+void capture_pixel(CAPTURE *cap, int x, int y, uint8_t color);
+void capture_frame_done(CAPTURE *cap);
+void capture_close(CAPTURE *cap);
+
+void capture_pack(const uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH], uint8_t packed[CAPTURE_FRAME_BYTES]);
+size_t capture_rle_encode(const uint8_t *in, size_t len, uint8_t *out);
+bool capture_rle_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+bool capture_write_png(const char *path, const uint8_t packed[CAPTURE_FRAME_BYTES]);
+void capture_write_y4m_header(FILE *out);
+void capture_write_y4m_frame(FILE *out, const uint8_t packed[CAPTURE_FRAME_BYTES]);
+
+#endif
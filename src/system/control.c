@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+
+static bool write_all(int fd, const void *buf, size_t len){
+    const uint8_t *p = buf;
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+
+/* This function creates the control socket at path, the controllers are 
+   accepted later by control_service. With paused the emulator waits for a 
+   command before running the first frame. */
+bool control_listen(CONTROL *ctrl, const char *path, bool paused){
+    memset(ctrl, 0, sizeof(CONTROL));
+    ctrl->server_fd = -1;
+    ctrl->client_fd = -1;
+    ctrl->paused    = paused;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return false;
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0){
+        close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    ctrl->server_fd = fd;
+    snprintf(ctrl->path, sizeof(ctrl->path), "%s", path);
+    return true;
+}
+
+
+
+void control_close(CONTROL *ctrl){
+    if(ctrl->client_fd >= 0) close(ctrl->client_fd);
+    if(ctrl->server_fd >= 0){
+        close(ctrl->server_fd);
+        unlink(ctrl->path);
+    }
+    ctrl->client_fd = -1;
+    ctrl->server_fd = -1;
+}
+
+
+
+static void disconnect(CONTROL *ctrl){
+    close(ctrl->client_fd);
+    ctrl->client_fd = -1;
+    ctrl->in_len  = 0;
+    ctrl->out_len = 0;
+    ctrl->frames_to_run = 0; // a step nobody waits for is abandoned
+}
+
+static void flush(CONTROL *ctrl){
+    if(ctrl->out_len == 0 || ctrl->client_fd < 0) return;
+    if(!write_all(ctrl->client_fd, ctrl->out, ctrl->out_len)) disconnect(ctrl);
+    ctrl->out_len = 0;
+}
+
+/* Queues a reply, the replies are written together when the requests 
+   available have been handled */
+static void reply(CONTROL *ctrl, uint8_t op, uint8_t status, uint64_t value, const void *payload, uint32_t length){
+    if(ctrl->out_len + sizeof(CONTROL_REPLY) + length > CONTROL_OUT_BUFFER_SIZE) flush(ctrl);
+    if(ctrl->client_fd < 0) return;
+
+    CONTROL_REPLY header = { .op = op, .status = status, .length = length, .value = value };
+    memcpy(ctrl->out + ctrl->out_len, &header, sizeof(header));
+    ctrl->out_len += sizeof(header);
+    if(length > 0){
+        memcpy(ctrl->out + ctrl->out_len, payload, length);
+        ctrl->out_len += length;
+    }
+}
+
+
+
+/* This function executes one request on the emulator, that is bound */
+static void execute(CONTROL *ctrl, EMULATOR *emu, const CONTROL_REQUEST *req, const uint8_t *payload){
+    ctrl->commands++;
+
+    switch(req->op){
+        case CONTROL_PAUSE:
+            ctrl->paused = req->arg0 != 0;
+            break;
+
+        case CONTROL_STEP:
+            ctrl->frames_to_run = req->arg0;
+            if(ctrl->frames_to_run > 0) return; // replied by control_frame_done
+            break;
+
+        case CONTROL_SET_INPUT:
+            for(int button = 0; button < 8; button++){
+                joypad_set_button(button, (req->arg0 >> button) & 1);
+            }
+            break;
+
+        case CONTROL_PEEK: {
+            uint8_t bytes[CONTROL_MAX_PEEK];
+            uint32_t count = req->arg1;
+            if(req->arg0 > 0xFFFF || count > CONTROL_MAX_PEEK || req->arg0 + count > 0x10000){
+                reply(ctrl, req->op, CONTROL_ERROR, ctrl->frames, NULL, 0);
+                return;
+            }
+            for(uint32_t i = 0; i < count; i++){
+                uint32_t addr = req->arg0 + i;
+                bytes[i] = addr < ROM_SIZE ? emu->rom[addr] : RAM_BYTE(emu->ram, addr);
+            }
+            reply(ctrl, req->op, CONTROL_OK, ctrl->frames, bytes, count);
+            return;
+        }
+
+        case CONTROL_POKE:
+            // memory is written directly, writes do not trigger what they would do from the CPU
+            if(req->arg0 > 0xFFFF || req->arg0 < ROM_SIZE || (uint64_t)req->arg0 + req->length > 0x10000){
+                reply(ctrl, req->op, CONTROL_ERROR, ctrl->frames, NULL, 0);
+                return;
+            }
+            memcpy(&RAM_BYTE(emu->ram, req->arg0), payload, req->length);
+            break;
+
+        case CONTROL_SAVE_STATE: {
+            static uint8_t state[EMULATOR_STATE_SIZE];
+            emulator_save_state(emu, state);
+            reply(ctrl, req->op, CONTROL_OK, ctrl->frames, state, EMULATOR_STATE_SIZE);
+            return;
+        }
+
+        case CONTROL_LOAD_STATE:
+            if(!emulator_load_state(emu, payload, req->length)){
+                reply(ctrl, req->op, CONTROL_ERROR, ctrl->frames, NULL, 0);
+                return;
+            }
+            break;
+
+        case CONTROL_FRAME_HASH:
+            reply(ctrl, req->op, CONTROL_OK, ctrl->frame_hash, NULL, 0);
+            return;
+
+        case CONTROL_QUIT:
+            emu->cpu.running = false;
+            break;
+
+        case CONTROL_TRACE: {
+            TRACER *t = emulator_tracer(emu);
+            if(t == NULL || !t->active){
+                reply(ctrl, req->op, CONTROL_ERROR, ctrl->frames, NULL, 0);
+                return;
+            }
+            t->enabled = req->arg0 != 0;
+            break;
+        }
+
+        default:
+            reply(ctrl, req->op, CONTROL_UNKNOWN_OP, ctrl->frames, NULL, 0);
+            return;
+    }
+    reply(ctrl, req->op, CONTROL_OK, ctrl->frames, NULL, 0);
+}
+
+
+
+/* This function reads what the controller sent and executes the complete 
+   requests, stopping at a STEP that still has frames to run */
+static void handle_requests(CONTROL *ctrl, EMULATOR *emu){
+    if(ctrl->client_fd < 0) return;
+
+    if(ctrl->in_len < CONTROL_IN_BUFFER_SIZE){ // when full the requests wait behind a STEP
+        ssize_t n = recv(ctrl->client_fd, ctrl->in + ctrl->in_len, CONTROL_IN_BUFFER_SIZE - ctrl->in_len, MSG_DONTWAIT);
+        if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)){
+            disconnect(ctrl);
+            return;
+        }
+        if(n > 0) ctrl->in_len += n;
+    }
+
+    size_t offset = 0;
+    while(ctrl->frames_to_run == 0 && emu->cpu.running && ctrl->in_len - offset >= sizeof(CONTROL_REQUEST)){
+        CONTROL_REQUEST req;
+        memcpy(&req, ctrl->in + offset, sizeof(req));
+        if(sizeof(req) + req.length > CONTROL_IN_BUFFER_SIZE){
+            fprintf(stderr, "[ERROR] Control request of %u bytes is too big\n", req.length);
+            disconnect(ctrl);
+            return;
+        }
+        if(ctrl->in_len - offset < sizeof(req) + req.length) break; // the rest is still on the way
+
+        execute(ctrl, emu, &req, ctrl->in + offset + sizeof(req));
+        offset += sizeof(req) + req.length;
+    }
+    memmove(ctrl->in, ctrl->in + offset, ctrl->in_len - offset);
+    ctrl->in_len -= offset;
+}
+
+
+
+/* This function is called by the emulator loop before every frame: it 
+   accepts a controller, executes its requests and sends the replies. With
+   block it waits for commands while there is nothing to run.
+   Returns true if the next frame has to run. */
+bool control_service(CONTROL *ctrl, EMULATOR *emu, bool block){
+    emulator_bind(emu);
+
+    for(;;){
+        if(ctrl->client_fd < 0 && ctrl->server_fd >= 0){
+            ctrl->client_fd = accept(ctrl->server_fd, NULL, NULL);
+            if(ctrl->client_fd >= 0) fcntl(ctrl->client_fd, F_SETFL, 0); // replies are written blocking
+        }
+        handle_requests(ctrl, emu);
+        flush(ctrl);
+
+        bool run = !ctrl->paused || ctrl->frames_to_run > 0;
+        if(run || !block || !emu->cpu.running) return run && emu->cpu.running;
+
+        struct pollfd fds = { .fd = ctrl->client_fd >= 0 ? ctrl->client_fd : ctrl->server_fd, .events = POLLIN };
+        poll(&fds, 1, -1);
+    }
+}
+
+
+
+/* This function is called by the emulator loop after every frame, it ends a
+   STEP when its frames have run */
+void control_frame_done(CONTROL *ctrl){
+    ctrl->frames++;
+    if(ctrl->frames_to_run > 0 && --ctrl->frames_to_run == 0){
+        reply(ctrl, CONTROL_STEP, CONTROL_OK, ctrl->frames, NULL, 0);
+    }
+}
+
+
+
+/* Frame buffer hook that keeps the hash of the frames drawn */
+void control_pixel(CONTROL *ctrl, int x, int y, uint8_t color){
+    if(x == 0 && y == 0) ctrl->pixel_hash = FNV_OFFSET;
+    ctrl->pixel_hash = (ctrl->pixel_hash ^ color) * FNV_PRIME;
+    if(x == WINDOW_WIDTH - 1 && y == WINDOW_HEIGHT - 1) ctrl->frame_hash = ctrl->pixel_hash;
+}
@@ -0,0 +1,84 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../hardware/emulator.h"
+
+#define CONTROL_IN_BUFFER_SIZE  (128 * 1024) // room for a state to load and many pipelined requests
+#define CONTROL_OUT_BUFFER_SIZE (128 * 1024)
+#define CONTROL_MAX_PEEK 4096
+
+/* Commands of the control protocol. Requests are executed in order, a STEP 
+   holds the requests after it until its frames have run. */
+typedef enum CONTROL_OP {
+    CONTROL_PAUSE = 1,  // arg0: 1 pause, 0 resume
+    CONTROL_STEP,       // arg0: frames to run, the reply comes when they have run
+    CONTROL_SET_INPUT,  // arg0: mask of pressed buttons, bit n is JOYPAD_BUTTON n
+    CONTROL_PEEK,       // arg0: address, arg1: count; the reply carries the bytes
+    CONTROL_POKE,       // arg0: address, the request carries the bytes (only 0x8000-0xFFFF)
+    CONTROL_SAVE_STATE, // the reply carries the state
+    CONTROL_LOAD_STATE, // the request carries a state saved by the same build
+    CONTROL_FRAME_HASH, // value: hash of the last complete frame
+    CONTROL_QUIT,       // stops the emulator
+    CONTROL_TRACE       // arg0: 1 resume, 0 pause the trace; an error when there is no --trace
+} CONTROL_OP;
+
+typedef enum CONTROL_STATUS {
+    CONTROL_OK = 0,
+    CONTROL_ERROR,
+    CONTROL_UNKNOWN_OP
+} CONTROL_STATUS;
+
+/* Every request is this header followed by length bytes. The protocol is
+   local only so fields are in the byte order of the machine. */
+typedef struct CONTROL_REQUEST {
+    uint8_t op;
+    uint8_t reserved[3];
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t length;
+} CONTROL_REQUEST;
+
+/* Every request gets exactly one reply, this header followed by length bytes.
+   value is the frame hash for CONTROL_FRAME_HASH and the frames completed so
+   far for the other commands. */
+typedef struct CONTROL_REPLY {
+    uint8_t op;
+    uint8_t status;
+    uint8_t reserved[2];
+    uint32_t length;
+    uint64_t value;
+} CONTROL_REPLY;
+
+/* Server side, handled by the emulator loop between two frames. One 
+   controller is connected at a time, the next one is accepted when it goes. */
+typedef struct CONTROL {
+    int server_fd;
+    int client_fd;
+    char path[108];
+
+    bool paused;
+    uint32_t frames_to_run; // left of the STEP being executed
+    uint64_t frames;        // frames completed since the start
+
+    uint64_t pixel_hash;    // hash of the frame being drawn
+    uint64_t frame_hash;    // hash of the last complete frame
+
+    uint64_t commands;
+
+    uint8_t in[CONTROL_IN_BUFFER_SIZE];
+    size_t in_len;
+    uint8_t out[CONTROL_OUT_BUFFER_SIZE];
+    size_t out_len;
+} CONTROL;
+
+bool control_listen(CONTROL *ctrl, const char *path, bool paused);
+void control_close(CONTROL *ctrl);
+bool control_service(CONTROL *ctrl, EMULATOR *emu, bool block);
+void control_frame_done(CONTROL *ctrl);
+void control_pixel(CONTROL *ctrl, int x, int y, uint8_t color);
+
+#endif
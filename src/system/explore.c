@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "explore.h"
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+static uint64_t frame_hash;
+
+
+static uint64_t hash_bytes(const uint8_t *data, size_t len){
+    uint64_t hash = FNV_OFFSET;
+    for(size_t i = 0; i < len; i++){
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Frame buffer callback of the children, they only need to know what was drawn */
+static void hash_frame_buffer(int x, int y, uint8_t color){
+    if(x == 0 && y == 0) frame_hash = FNV_OFFSET;
+    frame_hash = (frame_hash ^ color) * FNV_PRIME;
+}
+
+
+
+/* This function is what runs in a child. The emulator state was inherited
+   with the fork so it only applies its input sequence, reports through the 
+   pipe and exits without going back to the caller (and to SDL). */
+static void explore_child(EMULATOR *emu, const EXPLORE_INPUT *input, int index, int frames, int fd){
+    emu->ppu.process_frame_buffer = hash_frame_buffer;
+    serial.backend = NULL; // files and sockets of the parent must not see the children
+    emulator_set_tracer(emu, NULL); // its writer thread was not forked, the ring would fill up and wait forever
+    frame_hash = FNV_OFFSET;
+
+    for(int frame = 0; frame < frames && emu->cpu.running; frame++){
+        if(input->length > 0){
+            uint8_t mask = input->buttons[frame < input->length ? frame : input->length - 1];
+            for(int button = 0; button < 8; button++){
+                joypad_set_button(button, (mask >> button) & 1);
+            }
+        }
+        emulator_run(emu, 0, CYCLES_PER_FRAME);
+    }
+
+    EXPLORE_RESULT result = {
+        .index      = index,
+        .status     = 0,
+        .pc         = emu->cpu.PC,
+        .running    = emu->cpu.running,
+        .frame_hash = frame_hash,
+        .wram_hash  = hash_bytes(&MEM(0xC000), 0x2000),
+        .hram_hash  = hash_bytes(&MEM(0xFF80), 0x7F)
+    };
+    // smaller than PIPE_BUF so the write is atomic even with many children on the same pipe
+    ssize_t written = write(fd, &result, sizeof(result));
+    _exit(written == sizeof(result) ? 0 : 1);
+}
+
+
+
+/* This function explores count input sequences from the current state of the
+   bound emulator. Every sequence runs for frames frames in a child process
+   that gets the whole state by copy on write, at most max_parallel children
+   run at the same time. results[i] is filled for inputs[i], the children that
+   died before reporting have status -1. Returns the number of results received. */
+int explore_fork(EMULATOR *emu, const EXPLORE_INPUT *inputs, int count, int frames, 
+                 int max_parallel, EXPLORE_RESULT *results){
+    if(count > EXPLORE_MAX_CHILDREN) count = EXPLORE_MAX_CHILDREN;
+    if(max_parallel < 1) max_parallel = 1;
+
+    int pipe_fds[2];
+    if(pipe(pipe_fds) != 0) return 0;
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+
+    for(int i = 0; i < count; i++){
+        results[i] = (EXPLORE_RESULT){ .index = i, .status = -1 };
+    }
+
+    // the children share the parent buffers, pending output would be written twice
+    fflush(stdout);
+    fflush(stderr);
+    emulator_bind(emu); // the children run on the bound emulator
+
+    int started = 0, running = 0, received = 0;
+    while(started < count || running > 0){
+        while(started < count && running < max_parallel){
+            pid_t pid = fork();
+            if(pid == 0){
+                close(pipe_fds[0]);
+                explore_child(emu, &inputs[started], started, frames, pipe_fds[1]);
+            }
+            if(pid > 0) running++;
+            started++;
+        }
+
+        if(running > 0){
+            if(wait(NULL) > 0) running--;
+            else if(errno == ECHILD) running = 0;
+        }
+
+        // a child writes its result before exiting so it is already in the pipe
+        EXPLORE_RESULT result;
+        while(read(pipe_fds[0], &result, sizeof(result)) == sizeof(result)){
+            if(result.index >= 0 && result.index < count){
+                results[result.index] = result;
+                received++;
+            }
+        }
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return received;
+}
@@ -0,0 +1,32 @@
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../hardware/emulator.h"
+
+#define EXPLORE_MAX_CHILDREN 256
+
+/* Input sequence applied by a child, one mask of pressed buttons per frame
+   (bit n is JOYPAD_BUTTON n). After the last entry the last mask is held. */
+typedef struct EXPLORE_INPUT {
+    const uint8_t *buttons;
+    int length;
+} EXPLORE_INPUT;
+
+/* What a child reports back after running its input sequence */
+typedef struct EXPLORE_RESULT {
+    int32_t index;    // input sequence that produced it
+    int32_t status;   // 0 ok, -1 the child died before reporting
+    uint16_t pc;
+    bool running;
+    uint64_t frame_hash; // hash of the last frame drawn
+    uint64_t wram_hash;  // hash of 0xC000-0xDFFF
+    uint64_t hram_hash;  // hash of 0xFF80-0xFFFE
+} EXPLORE_RESULT;
+
+int explore_fork(EMULATOR *emu, const EXPLORE_INPUT *inputs, int count, int frames, 
+                 int max_parallel, EXPLORE_RESULT *results);
+
+#endif
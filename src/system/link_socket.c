@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "link_socket.h"
+
+/* Header of the message exchanged at every synchronization, followed by the
+   count bytes sent as master and the answers bytes shifted out for the peer */
+typedef struct LINK_MESSAGE {
+    uint8_t count;
+    uint8_t answers;
+    uint8_t reserved[2];
+} LINK_MESSAGE;
+
+
+static bool write_all(int fd, const void *buf, size_t len){
+    const uint8_t *p = buf;
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len){
+    uint8_t *p = buf;
+    while(len > 0){
+        ssize_t n = read(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+
+static uint8_t pop_byte(uint8_t *queue, uint32_t *len){
+    uint8_t byte = queue[0];
+    memmove(queue, queue + 1, --*len);
+    return byte;
+}
+
+
+
+/* Serial backend reply: the answer of the peer to the byte sent or, when the
+   peer started a transfer too, the byte it sent */
+static int link_socket_reply(void *ctx){
+    LINK_SOCKET *link = ctx;
+
+    if(link->replies_len > 0) return pop_byte(link->replies, &link->replies_len);
+    if(link->rx_len > 0) return pop_byte(link->rx, &link->rx_len);
+    if(link->fd < 0) return 0xFF; // unplugged, the line stays high
+    return SERIAL_PENDING;
+}
+
+
+
+/* Serial backend exchange: the byte goes in the batch of this quantum and 
+   the transfer is held until the peer answers it */
+static int link_socket_exchange(void *ctx, uint8_t out){
+    LINK_SOCKET *link = ctx;
+
+    if(link->fd < 0) return 0xFF;
+    if(link->tx_len == LINK_SOCKET_MAX_BATCH && !link_socket_sync(link)) return 0xFF;
+
+    link->replies_len = 0; // answers to transfers the game gave up on
+    link->tx[link->tx_len++] = out;
+    link->bytes_sent++;
+    return link_socket_reply(link);
+}
+
+
+
+/* Serial backend listen: the oldest byte sent by the peer is clocked in 
+   while this side waits on the external clock, what was in SB goes back */
+static void link_socket_deliver(void *ctx){
+    LINK_SOCKET *link = ctx;
+
+    if(link->rx_len == 0) return;
+    if(link->answers_len == LINK_SOCKET_MAX_BATCH && !link_socket_sync(link)) return;
+
+    uint8_t in = pop_byte(link->rx, &link->rx_len);
+    link->answers[link->answers_len++] = serial_receive(ram, in);
+}
+
+
+
+static void link_socket_setup(LINK_SOCKET *link, int fd, int quantum){
+    memset(link, 0, sizeof(LINK_SOCKET));
+    if(quantum <= 0) quantum = LINK_SOCKET_QUANTUM_DEFAULT;
+    if(quantum > LINK_SOCKET_QUANTUM_MAX) quantum = LINK_SOCKET_QUANTUM_MAX;
+
+    link->fd = fd;
+    link->quantum = quantum;
+    link->cycles_to_sync = quantum;
+    link->backend.exchange = link_socket_exchange;
+    link->backend.reply    = link_socket_reply;
+    link->backend.listen   = link_socket_deliver;
+    link->backend.flush    = NULL;
+    link->backend.ctx      = link;
+}
+
+static bool make_address(struct sockaddr_un *addr, const char *path){
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr->sun_path)) return false;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+
+
+/* This function creates the socket at path and waits for the other side.
+   Both sides must use the same quantum. */
+bool link_socket_listen(LINK_SOCKET *link, const char *path, int quantum){
+    struct sockaddr_un addr;
+    if(!make_address(&addr, path)) return false;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0) return false;
+
+    unlink(path);
+    if(bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0){
+        close(server);
+        return false;
+    }
+
+    int fd = accept(server, NULL, NULL);
+    close(server);
+    unlink(path);
+    if(fd < 0) return false;
+
+    link_socket_setup(link, fd, quantum);
+    return true;
+}
+
+
+
+/* This function connects to a socket created by link_socket_listen, retrying
+   for a while so the two processes can be started in any order */
+bool link_socket_connect(LINK_SOCKET *link, const char *path, int quantum){
+    struct sockaddr_un addr;
+    if(!make_address(&addr, path)) return false;
+
+    for(int i = 0; i < LINK_SOCKET_CONNECT_RETRIES; i++){
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) return false;
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0){
+            link_socket_setup(link, fd, quantum);
+            return true;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return false;
+}
+
+
+
+void link_socket_close(LINK_SOCKET *link){
+    if(link->fd >= 0) close(link->fd);
+    link->fd = -1;
+}
+
+
+
+/* This function synchronizes with the peer at the end of a quantum or when 
+   a batch is full. The bytes of the peer are queued, they reach the bound 
+   emulator through the serial backend. Returns false if the peer went away. */
+bool link_socket_sync(LINK_SOCKET *link){
+    if(link->fd < 0) return false;
+
+    uint8_t message[sizeof(LINK_MESSAGE) + 2 * LINK_SOCKET_MAX_BATCH];
+    LINK_MESSAGE header = {
+        .count   = link->tx_len,
+        .answers = link->answers_len
+    };
+    memcpy(message, &header, sizeof(LINK_MESSAGE));
+    memcpy(message + sizeof(LINK_MESSAGE), link->tx, link->tx_len);
+    memcpy(message + sizeof(LINK_MESSAGE) + link->tx_len, link->answers, link->answers_len);
+
+    // a single write per quantum, both sides write before reading so they never wait for each other twice
+    if(!write_all(link->fd, message, sizeof(LINK_MESSAGE) + link->tx_len + link->answers_len)) goto disconnected;
+    link->tx_len = 0;
+    link->answers_len = 0;
+
+    if(!read_all(link->fd, &header, sizeof(LINK_MESSAGE))) goto disconnected;
+    uint8_t incoming[2 * LINK_SOCKET_MAX_BATCH];
+    if(!read_all(link->fd, incoming, header.count + header.answers)) goto disconnected;
+
+    // the peer holds every transfer until it is answered so the queues only fill up when a game gives up on them
+    for(uint32_t i = 0; i < header.count; i++){
+        if(link->rx_len < LINK_SOCKET_MAX_BATCH) link->rx[link->rx_len++] = incoming[i];
+        else link->answers[link->answers_len++] = 0xFF; // as if this side was not listening
+    }
+    for(uint32_t i = header.count; i < header.count + header.answers && link->replies_len < LINK_SOCKET_MAX_BATCH; i++){
+        link->replies[link->replies_len++] = incoming[i];
+    }
+    link->bytes_received += header.count;
+
+    link->syncs++;
+    return true;
+
+disconnected:
+    fprintf(stderr, "[ERROR] Link cable disconnected\n");
+    link_socket_close(link);
+    return false;
+}
+
+
+
+/* This function runs the bound emulator from cycle to end_cycle of the current
+   frame, stopping to synchronize with the peer every quantum cycles. Returns 
+   the cycle reached. */
+int link_socket_run(LINK_SOCKET *link, EMULATOR *emu, int cycle, int end_cycle){
+    while(cycle < end_cycle && emu->cpu.running){
+        int slice_end = cycle + link->cycles_to_sync;
+        if(slice_end > end_cycle) slice_end = end_cycle;
+
+        int reached = emulator_run(emu, cycle, slice_end);
+        link->cycles_to_sync -= reached - cycle;
+        cycle = reached;
+
+        if(link->cycles_to_sync <= 0){
+            link->cycles_to_sync += link->quantum;
+            if(!link_socket_sync(link)) link->cycles_to_sync = 1 << 30; // unplugged, keep running alone
+        }
+    }
+    return cycle;
+}
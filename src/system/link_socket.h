@@ -0,0 +1,50 @@
+#ifndef LINK_SOCKET_H
+#define LINK_SOCKET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../hardware/emulator.h"
+
+#define LINK_SOCKET_QUANTUM_DEFAULT 4096    // one byte transfer on the internal clock
+#define LINK_SOCKET_QUANTUM_MAX     1000000 // a transfer can wait up to two quanta for its reply
+#define LINK_SOCKET_MAX_BATCH       255     // bytes of each kind in a message, a full batch forces a synchronization
+#define LINK_SOCKET_CONNECT_RETRIES 100     // 10 ms apart
+
+/* Link cable between two processes over a Unix domain socket. Instead of a 
+   round trip for every bit both sides stop every quantum cycles and exchange
+   one message with the bytes they sent as master during the quantum and the
+   bytes they shifted out answering the bytes of the peer. A transfer started
+   by this side is held until the answer of the peer arrives, the peer gets 
+   the byte at the next synchronization and answers it as soon as it waits on
+   the external clock. When both sides started a transfer they answer each 
+   other with their own byte. Smaller quanta mean less latency and more 
+   messages, the bytes are never dropped. */
+typedef struct LINK_SOCKET {
+    int fd;
+    int quantum;
+    int cycles_to_sync;
+
+    uint8_t tx[LINK_SOCKET_MAX_BATCH];      // bytes sent as master in the current quantum
+    uint32_t tx_len;
+    uint8_t answers[LINK_SOCKET_MAX_BATCH]; // bytes shifted out for the peer in the current quantum
+    uint32_t answers_len;
+    uint8_t rx[LINK_SOCKET_MAX_BATCH];      // bytes sent by the peer as master, not yet answered
+    uint32_t rx_len;
+    uint8_t replies[LINK_SOCKET_MAX_BATCH]; // answers of the peer not yet taken by a transfer
+    uint32_t replies_len;
+
+    uint64_t syncs;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+
+    SERIAL_BACKEND backend;
+} LINK_SOCKET;
+
+bool link_socket_listen(LINK_SOCKET *link, const char *path, int quantum);
+bool link_socket_connect(LINK_SOCKET *link, const char *path, int quantum);
+void link_socket_close(LINK_SOCKET *link);
+bool link_socket_sync(LINK_SOCKET *link);
+int link_socket_run(LINK_SOCKET *link, EMULATOR *emu, int cycle, int end_cycle);
+
+#endif
@@ -0,0 +1,236 @@
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#include "pacing.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+
+/* This function returns the current monotonic time in nanoseconds */
+uint64_t pacer_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+
+
+/* This function sleeps until the absolute monotonic time passed, an absolute
+   sleep is not affected by the time spent before calling it */
+static void sleep_until_ns(uint64_t deadline_ns){
+    struct timespec ts = {
+        .tv_sec  = deadline_ns / NANOSECONDS_PER_SECOND,
+        .tv_nsec = deadline_ns % NANOSECONDS_PER_SECOND
+    };
+#ifdef __APPLE__
+    // macOS has no clock_nanosleep, the relative sleep is still computed from the deadline
+    uint64_t now = pacer_now_ns();
+    if(deadline_ns <= now) return;
+    uint64_t remaining = deadline_ns - now;
+    ts.tv_sec  = remaining / NANOSECONDS_PER_SECOND;
+    ts.tv_nsec = remaining % NANOSECONDS_PER_SECOND;
+    while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+#else
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+
+
+void pacer_init(PACER *pacer, double frame_rate_hz, PACING_POLICY policy, uint64_t spin_ns){
+    memset(pacer, 0, sizeof(PACER));
+    pacer->policy    = policy;
+    pacer->period_ns = (uint64_t)(NANOSECONDS_PER_SECOND / frame_rate_hz);
+    pacer->spin_ns   = spin_ns;
+
+    pacer->deadline_ns   = pacer_now_ns();
+    pacer->last_frame_ns = pacer->deadline_ns;
+}
+
+
+
+/* This function waits for the start of the next frame. The deadline always
+   advances by exactly one period so a frame that overruns is caught up by the
+   following ones. The last spin_ns before the deadline are busy-waited because
+   the scheduler wake up latency is usually larger than that.
+   Returns true if the next frame has to be presented. */
+bool pacer_wait(PACER *pacer){
+    pacer->deadline_ns += pacer->period_ns;
+    uint64_t now = pacer_now_ns();
+    bool present = true;
+
+    if(now < pacer->deadline_ns){
+        if(pacer->deadline_ns - now > pacer->spin_ns){
+            // the jitter is how late the sleep returns, before the spin hides it
+            uint64_t wake_ns = pacer->deadline_ns - pacer->spin_ns;
+            sleep_until_ns(wake_ns);
+            now = pacer_now_ns();
+            histogram_add(&pacer->jitter, now > wake_ns ? now - wake_ns : 0);
+        }
+        while((now = pacer_now_ns()) < pacer->deadline_ns); // spin for the last part
+    }
+    else{
+        pacer->late_frames++;
+        uint64_t behind_frames = (now - pacer->deadline_ns) / pacer->period_ns;
+
+        if(behind_frames > PACER_MAX_BEHIND_FRAMES){
+            // too far behind to catch up (e.g. the process was suspended), start again from now
+            pacer->deadline_ns = now;
+            pacer->resyncs++;
+        }
+        else if(pacer->policy == PACING_DROP){
+            present = false;
+            pacer->skipped_frames++;
+        }
+    }
+
+    histogram_add(&pacer->frame_time, now - pacer->last_frame_ns);
+    pacer->last_frame_ns = now;
+    return present;
+}
+
+
+
+/* This function records the start of a frame that was paced by something else
+   (the vsync present), the deadline follows so pacer_wait can take over */
+void pacer_mark_frame(PACER *pacer){
+    uint64_t now = pacer_now_ns();
+    histogram_add(&pacer->frame_time, now - pacer->last_frame_ns);
+    pacer->last_frame_ns = now;
+    pacer->deadline_ns   = now;
+}
+
+
+
+void histogram_add(FRAME_HISTOGRAM *histogram, uint64_t ns){
+    size_t bucket = ns / FRAME_HISTOGRAM_BUCKET_NS;
+    if(bucket >= FRAME_HISTOGRAM_BUCKETS) bucket = FRAME_HISTOGRAM_BUCKETS - 1;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->total_ns += ns;
+    if(ns > histogram->max_ns) histogram->max_ns = ns;
+}
+
+
+
+/* This function returns the upper bound of the bucket containing the requested
+   percentile (0-100), so the result has the resolution of a bucket */
+uint64_t histogram_percentile(const FRAME_HISTOGRAM *histogram, double percentile){
+    if(histogram->count == 0) return 0;
+
+    uint64_t target = (uint64_t)(histogram->count * percentile / 100.0);
+    if(target >= histogram->count) target = histogram->count - 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < FRAME_HISTOGRAM_BUCKETS; i++){
+        seen += histogram->buckets[i];
+        if(seen > target){
+            uint64_t upper = (i + 1) * FRAME_HISTOGRAM_BUCKET_NS;
+            return upper < histogram->max_ns ? upper : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+
+
+/* Copies a one line summary of the pacer statistics inside the buffer */
+void pacer_get_stats(const PACER *pacer, char *buf, size_t len){
+    snprintf(buf, len, "frame p50 %.2f p99 %.2f max %.2f ms, jitter p99 %.3f ms, late %llu",
+             histogram_percentile(&pacer->frame_time, 50) / 1e6,
+             histogram_percentile(&pacer->frame_time, 99) / 1e6,
+             pacer->frame_time.max_ns / 1e6,
+             histogram_percentile(&pacer->jitter, 99) / 1e6,
+             (unsigned long long)pacer->late_frames);
+}
+
+
+
+void pacer_print_stats(const PACER *pacer, FILE *out){
+    const FRAME_HISTOGRAM *ft = &pacer->frame_time;
+    const FRAME_HISTOGRAM *jt = &pacer->jitter;
+
+    fprintf(out, "[STATS] frames: %llu, target frame time: %.3f ms\n",
+            (unsigned long long)ft->count, pacer->period_ns / 1e6);
+    if(ft->count == 0) return;
+
+    fprintf(out, "[STATS] frame time  avg %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n",
+            ft->total_ns / (double)ft->count / 1e6,
+            histogram_percentile(ft, 50) / 1e6, histogram_percentile(ft, 99) / 1e6, ft->max_ns / 1e6);
+    if(jt->count > 0){
+        fprintf(out, "[STATS] wake jitter avg %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n",
+                jt->total_ns / (double)jt->count / 1e6,
+                histogram_percentile(jt, 50) / 1e6, histogram_percentile(jt, 99) / 1e6, jt->max_ns / 1e6);
+    }
+    fprintf(out, "[STATS] late frames: %llu, skipped presents: %llu, resyncs: %llu\n",
+            (unsigned long long)pacer->late_frames, (unsigned long long)pacer->skipped_frames,
+            (unsigned long long)pacer->resyncs);
+}
+
+
+
+/* This function updates the swap interval and the rate needed to show one
+   emulated frame every swap_interval refreshes */
+static void vsync_update_rate(VSYNC_CONTROLLER *vsync){
+    double refresh_hz = NANOSECONDS_PER_SECOND / vsync->refresh_period_ns;
+
+    vsync->swap_interval = (int)lround(refresh_hz / vsync->native_hz);
+    if(vsync->swap_interval < 1) vsync->swap_interval = 1;
+
+    vsync->rate   = refresh_hz / vsync->swap_interval / vsync->native_hz;
+    vsync->locked = fabs(vsync->rate - 1.0) <= VSYNC_MAX_RATE_ADJUST;
+}
+
+
+
+void vsync_init(VSYNC_CONTROLLER *vsync, double native_hz, double refresh_hz){
+    memset(vsync, 0, sizeof(VSYNC_CONTROLLER));
+    if(refresh_hz <= 0) refresh_hz = 60; // the display did not report it, the presents will tell
+
+    vsync->native_hz = native_hz;
+    vsync->refresh_period_ns = NANOSECONDS_PER_SECOND / refresh_hz;
+    vsync_update_rate(vsync);
+}
+
+
+
+/* This function is called after every emulated frame has been presented. The
+   time since the previous present tells how many refreshes the previous frame 
+   stayed on screen, that is used to count duplicated and dropped frames and to
+   refine the estimate of the refresh period. */
+void vsync_presented(VSYNC_CONTROLLER *vsync, uint64_t now_ns){
+    vsync->presents++;
+
+    if(vsync->last_present_ns != 0){
+        double interval  = (double)(now_ns - vsync->last_present_ns);
+        long refreshes   = lround(interval / vsync->refresh_period_ns);
+        long expected    = vsync->locked ? vsync->swap_interval
+                                         : (long)(NANOSECONDS_PER_SECOND / vsync->refresh_period_ns / vsync->native_hz);
+        if(expected < 1) expected = 1;
+
+        if(refreshes > expected) vsync->duplicated += refreshes - expected;
+        else if(refreshes == 0)  vsync->dropped++; // present did not block, the frame never got a refresh
+
+        if(refreshes >= 1 && refreshes <= expected + 1){
+            /* presents are aligned to the vblank so the interval is a multiple of the period, 
+               a small step towards it filters out presents delayed by the scheduler */
+            vsync->refresh_period_ns += 0.02 * (interval / refreshes - vsync->refresh_period_ns);
+            vsync_update_rate(vsync);
+        }
+    }
+    vsync->last_present_ns = now_ns;
+}
+
+
+
+void vsync_print_stats(const VSYNC_CONTROLLER *vsync, FILE *out){
+    fprintf(out, "[STATS] vsync: refresh %.3f Hz, swap interval %d, rate %.4f (%s)\n",
+            NANOSECONDS_PER_SECOND / vsync->refresh_period_ns, vsync->swap_interval, vsync->rate,
+            vsync->locked ? "locked" : "not locked, paced by timer");
+    fprintf(out, "[STATS] vsync: presents %llu, duplicated %llu, dropped %llu\n",
+            (unsigned long long)vsync->presents, (unsigned long long)vsync->duplicated,
+            (unsigned long long)vsync->dropped);
+}
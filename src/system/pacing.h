@@ -0,0 +1,76 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define PACER_SPIN_NS_DEFAULT   200000 // last 200 us before a deadline are busy-waited
+#define PACER_MAX_BEHIND_FRAMES 15     // further behind than this the deadline is re-anchored
+
+#define VSYNC_MAX_RATE_ADJUST 0.005 // emulation may run up to 0.5% faster or slower to lock to the display
+
+#define FRAME_HISTOGRAM_BUCKET_NS 10000 // 10 us resolution
+#define FRAME_HISTOGRAM_BUCKETS   5000  // up to 50 ms, longer frames fall in the last bucket
+
+typedef enum {
+    PACING_CATCH_UP, // late frames are emulated and presented back to back until on time
+    PACING_DROP      // late frames are emulated but not presented until on time
+} PACING_POLICY;
+
+/* Histogram of frame times with fixed size buckets */
+typedef struct FRAME_HISTOGRAM {
+    uint32_t buckets[FRAME_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} FRAME_HISTOGRAM;
+
+/* Definition of frame pacer, frames are scheduled against a running absolute 
+   deadline so sleep errors do not accumulate */
+typedef struct PACER {
+    PACING_POLICY policy;
+    uint64_t period_ns;
+    uint64_t spin_ns;
+    uint64_t deadline_ns;
+    uint64_t last_frame_ns;
+
+    uint64_t late_frames;    // frames that started after their deadline
+    uint64_t skipped_frames; // frames not presented because of PACING_DROP
+    uint64_t resyncs;        // times the deadline was re-anchored to the current time
+
+    FRAME_HISTOGRAM frame_time; // time between two consecutive frame starts
+    FRAME_HISTOGRAM jitter;     // how late the sleep before a deadline returned, measured before the spin
+} PACER;
+
+/* Definition of vsync rate controller. When the display refresh is close enough
+   to a multiple of the emulated frame rate the emulation is slaved to the vsync
+   blocking present, otherwise frames are paced by the PACER as usual */
+typedef struct VSYNC_CONTROLLER {
+    double native_hz;
+    double refresh_period_ns; // measured from the presents, starts from the reported refresh rate
+    int swap_interval;        // refreshes per emulated frame when locked
+    double rate;              // emulated rate over native rate needed to lock
+    bool locked;
+
+    uint64_t last_present_ns;
+    uint64_t presents;
+    uint64_t duplicated; // refreshes that showed an already shown frame
+    uint64_t dropped;    // frames replaced before reaching the display
+} VSYNC_CONTROLLER;
+
+uint64_t pacer_now_ns(void);
+void pacer_init(PACER *pacer, double frame_rate_hz, PACING_POLICY policy, uint64_t spin_ns);
+bool pacer_wait(PACER *pacer);
+void pacer_mark_frame(PACER *pacer);
+
+void histogram_add(FRAME_HISTOGRAM *histogram, uint64_t ns);
+uint64_t histogram_percentile(const FRAME_HISTOGRAM *histogram, double percentile);
+void pacer_get_stats(const PACER *pacer, char *buf, size_t len);
+void pacer_print_stats(const PACER *pacer, FILE *out);
+
+void vsync_init(VSYNC_CONTROLLER *vsync, double native_hz, double refresh_hz);
+void vsync_presented(VSYNC_CONTROLLER *vsync, uint64_t now_ns);
+void vsync_print_stats(const VSYNC_CONTROLLER *vsync, FILE *out);
+
+#endif
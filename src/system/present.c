@@ -0,0 +1,121 @@
+#include <string.h>
+#include <time.h>
+
+#include "present.h"
+
+
+/* This function prepares an empty triple buffer, present is called on the
+   window thread for every frame shown */
+void presenter_init(PRESENTER *presenter, PRESENT_CALLBACK present, void *ctx){
+    memset(presenter, 0, sizeof(PRESENTER));
+    presenter->back  = 0;
+    presenter->front = 2;
+    atomic_init(&presenter->ready, 1);
+    presenter->present = present;
+    presenter->ctx     = ctx;
+
+    pthread_mutex_init(&presenter->lock, NULL);
+    pthread_cond_init(&presenter->wake, NULL);
+}
+
+
+
+/* This function returns the pixels the emulation thread fills with the next
+   frame, WINDOW_WIDTH pixels per row. They belong to it until the publish. */
+uint32_t *presenter_back_buffer(PRESENTER *presenter){
+    return &presenter->slots[presenter->back].pixels[0][0];
+}
+
+
+
+/* This function hands the back buffer to the window thread and takes a free
+   one in its place. It never waits: the wake up is skipped when the window 
+   thread holds the lock, it then finds the frame at its next timeout. */
+void presenter_publish(PRESENTER *presenter, uint64_t frame){
+    PRESENT_SLOT *slot = &presenter->slots[presenter->back];
+    slot->frame = frame;
+    slot->published_ns = pacer_now_ns();
+
+    int previous = atomic_exchange_explicit(&presenter->ready, presenter->back | PRESENT_FRESH, memory_order_acq_rel);
+    if(previous & PRESENT_FRESH) presenter->dropped++; // never shown, replaced by a newer frame
+    presenter->back = previous & ~PRESENT_FRESH;
+    presenter->published++;
+
+    if(pthread_mutex_trylock(&presenter->lock) == 0){
+        pthread_cond_signal(&presenter->wake);
+        pthread_mutex_unlock(&presenter->lock);
+    }
+}
+
+
+
+/* This function wakes the window thread waiting in presenter_show without a
+   new frame, e.g. when the emulation stops */
+void presenter_wake(PRESENTER *presenter){
+    pthread_mutex_lock(&presenter->lock);
+    pthread_cond_signal(&presenter->wake);
+    pthread_mutex_unlock(&presenter->lock);
+}
+
+
+
+/* This function shows the newest published frame, waiting up to timeout_ns 
+   for one when there is none. The window thread calls it between two polls 
+   of the events. Returns whether a frame was shown. */
+bool presenter_show(PRESENTER *presenter, uint64_t timeout_ns){
+    if(!(atomic_load_explicit(&presenter->ready, memory_order_acquire) & PRESENT_FRESH)){
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until); // the clock of a default condition variable
+        uint64_t nsec = until.tv_nsec + timeout_ns;
+        until.tv_sec += nsec / 1000000000ULL;
+        until.tv_nsec = nsec % 1000000000ULL;
+
+        pthread_mutex_lock(&presenter->lock);
+        if(!(atomic_load(&presenter->ready) & PRESENT_FRESH)){
+            pthread_cond_timedwait(&presenter->wake, &presenter->lock, &until);
+        }
+        pthread_mutex_unlock(&presenter->lock);
+        if(!(atomic_load_explicit(&presenter->ready, memory_order_acquire) & PRESENT_FRESH)) return false;
+    }
+
+    // the shown slot goes back without PRESENT_FRESH, the emulation thread will refill it
+    presenter->front = atomic_exchange_explicit(&presenter->ready, presenter->front, memory_order_acq_rel) & ~PRESENT_FRESH;
+    const PRESENT_SLOT *slot = &presenter->slots[presenter->front];
+
+    uint64_t start = pacer_now_ns();
+    presenter->present(&slot->pixels[0][0], WINDOW_WIDTH, presenter->ctx);
+    uint64_t end = pacer_now_ns();
+
+    histogram_add(&presenter->present_time, end - start);
+    histogram_add(&presenter->latency, end - slot->published_ns);
+    presenter->presented++;
+    return true;
+}
+
+
+
+/* This function releases the triple buffer, once the emulation thread is joined */
+void presenter_close(PRESENTER *presenter){
+    pthread_cond_destroy(&presenter->wake);
+    pthread_mutex_destroy(&presenter->lock);
+}
+
+
+
+/* This function prints the statistics of the frames handed to the window thread */
+void presenter_print_stats(const PRESENTER *presenter, FILE *out){
+    const FRAME_HISTOGRAM *pt = &presenter->present_time;
+    const FRAME_HISTOGRAM *lt = &presenter->latency;
+
+    fprintf(out, "[STATS] present: published %llu, presented %llu, dropped %llu\n",
+            (unsigned long long)presenter->published, (unsigned long long)presenter->presented,
+            (unsigned long long)presenter->dropped);
+    if(pt->count == 0) return;
+
+    fprintf(out, "[STATS] present time avg %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n",
+            pt->total_ns / (double)pt->count / 1e6,
+            histogram_percentile(pt, 50) / 1e6, histogram_percentile(pt, 99) / 1e6, pt->max_ns / 1e6);
+    fprintf(out, "[STATS] present latency avg %.3f  p50 %.3f  p99 %.3f  max %.3f ms\n",
+            lt->total_ns / (double)lt->count / 1e6,
+            histogram_percentile(lt, 50) / 1e6, histogram_percentile(lt, 99) / 1e6, lt->max_ns / 1e6);
+}
@@ -0,0 +1,62 @@
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "../hardware/ppu.h"
+#include "pacing.h"
+
+#define PRESENT_BUFFERS 3
+#define PRESENT_FRESH   4 // set in ready while the slot there was not taken by the window thread
+
+/* A completed frame, in the native resolution with the palette applied */
+typedef struct PRESENT_SLOT {
+    uint64_t frame;        // frames completed by the emulator when this one was published
+    uint64_t published_ns;
+    _Alignas(64) uint32_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH];
+} PRESENT_SLOT;
+
+/* Shows a frame, called on the window thread only. It owns the renderer. */
+typedef void (*PRESENT_CALLBACK)(const uint32_t *pixels, int pitch, void *ctx);
+
+/* Frames going from the emulation thread to the thread that created the 
+   window, which keeps the renderer and the events. They go through a triple
+   buffer: the emulation thread fills back and swaps it with ready, the window
+   thread swaps ready with front when it is fresh. Neither side ever waits for
+   the other, a frame published before the previous one was taken replaces it
+   and is counted as dropped. */
+typedef struct PRESENTER {
+    PRESENT_SLOT slots[PRESENT_BUFFERS];
+    int back;         // owned by the emulation thread
+    int front;        // owned by the window thread
+    _Atomic int ready;
+
+    pthread_mutex_t lock; // only to sleep on wake, the buffers do not need it
+    pthread_cond_t wake;
+
+    PRESENT_CALLBACK present;
+    void *ctx;
+
+    // written by the emulation thread
+    uint64_t published;
+    uint64_t dropped;
+
+    // written by the window thread
+    uint64_t presented;
+    FRAME_HISTOGRAM present_time; // callback duration, SDL_RenderPresent included
+    FRAME_HISTOGRAM latency;      // from publish to the end of the present
+} PRESENTER;
+
+void presenter_init(PRESENTER *presenter, PRESENT_CALLBACK present, void *ctx);
+uint32_t *presenter_back_buffer(PRESENTER *presenter);
+void presenter_publish(PRESENTER *presenter, uint64_t frame);
+void presenter_wake(PRESENTER *presenter);
+bool presenter_show(PRESENTER *presenter, uint64_t timeout_ns);
+void presenter_close(PRESENTER *presenter);
+void presenter_print_stats(const PRESENTER *presenter, FILE *out);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_export.h"
+
+
+/* This function creates (or reuses) the shared memory segment with the name
+   passed, e.g. "/gameboy", and maps it. Returns false if it cannot. */
+bool shm_export_open(SHM_EXPORT *exp, const char *name){
+    memset(exp, 0, sizeof(SHM_EXPORT));
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if(fd < 0) return false;
+    if(ftruncate(fd, sizeof(SHM_EXPORT_REGION)) != 0){
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *region = mmap(NULL, sizeof(SHM_EXPORT_REGION), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED){
+        shm_unlink(name);
+        return false;
+    }
+
+    exp->region = region;
+    snprintf(exp->name, sizeof(exp->name), "%s", name);
+    memset(exp->region, 0, sizeof(SHM_EXPORT_REGION));
+    exp->region->width   = WINDOW_WIDTH;
+    exp->region->height  = WINDOW_HEIGHT;
+    exp->region->version = SHM_EXPORT_VERSION;
+    atomic_thread_fence(memory_order_release);
+    exp->region->magic   = SHM_EXPORT_MAGIC; // last, readers wait for it
+    return true;
+}
+
+
+
+/* This function copies the collected frame and the WRAM passed into the next
+   slot. The seqlock makes readers retry or skip a slot that is being written,
+   the writer never waits for them. */
+void shm_export_publish(SHM_EXPORT *exp, const uint8_t *wram){
+    exp->frame++;
+    SHM_EXPORT_SLOT *slot = &exp->region->slots[exp->frame % SHM_EXPORT_SLOTS];
+    uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // the odd value is visible before the data changes
+
+    slot->frame = exp->frame;
+    memcpy(slot->pixels, exp->pixels, sizeof(slot->pixels));
+    memcpy(slot->wram, wram, SHM_EXPORT_WRAM_SIZE);
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&exp->region->latest, exp->frame, memory_order_release);
+}
+
+
+
+void shm_export_close(SHM_EXPORT *exp){
+    if(exp->region == NULL) return;
+    munmap(exp->region, sizeof(SHM_EXPORT_REGION));
+    shm_unlink(exp->name);
+    exp->region = NULL;
+}
+
+
+
+/* This function maps read only the segment exported by an emulator. Returns
+   NULL if it does not exist or it is not a compatible export. */
+const SHM_EXPORT_REGION *shm_export_attach(const char *name){
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0) return NULL;
+
+    void *region = mmap(NULL, sizeof(SHM_EXPORT_REGION), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED) return NULL;
+
+    const SHM_EXPORT_REGION *exported = region;
+    if(exported->magic != SHM_EXPORT_MAGIC || exported->version != SHM_EXPORT_VERSION){
+        munmap(region, sizeof(SHM_EXPORT_REGION));
+        return NULL;
+    }
+    return exported;
+}
+
+
+
+void shm_export_detach(const SHM_EXPORT_REGION *region){
+    munmap((void *)region, sizeof(SHM_EXPORT_REGION));
+}
+
+
+
+/* This function returns the slot of the latest frame to be read in place, or
+   NULL if there is no frame yet or the slot is being written. The sequence
+   must be passed to shm_export_read_end once the reader is done with it. */
+const SHM_EXPORT_SLOT *shm_export_read_begin(const SHM_EXPORT_REGION *region, uint64_t *sequence){
+    uint64_t latest = atomic_load_explicit(&region->latest, memory_order_acquire);
+    if(latest == 0) return NULL;
+
+    const SHM_EXPORT_SLOT *slot = &region->slots[latest % SHM_EXPORT_SLOTS];
+    *sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if(*sequence & 1) return NULL;
+    return slot;
+}
+
+
+
+/* Returns true if the slot was not touched by the writer since 
+   shm_export_read_begin, what was read from it is a consistent frame */
+bool shm_export_read_end(const SHM_EXPORT_SLOT *slot, uint64_t sequence){
+    atomic_thread_fence(memory_order_acquire); // the reads of the data happen before the check
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+}
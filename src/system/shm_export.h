@@ -0,0 +1,55 @@
+#ifndef SHM_EXPORT_H
+#define SHM_EXPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "../hardware/ppu.h"
+
+#define SHM_EXPORT_MAGIC   0x48534247 // "GBSH"
+#define SHM_EXPORT_VERSION 1
+#define SHM_EXPORT_SLOTS   2
+#define SHM_EXPORT_WRAM_SIZE 0x2000 // 0xC000-0xDFFF
+
+/* One exported frame. sequence is a seqlock: it is odd while the writer 
+   updates the slot, a reader that sees the same even value before and after 
+   reading got a consistent frame. pixels are the shades 0-3 after the palette. */
+typedef struct SHM_EXPORT_SLOT {
+    _Alignas(64) _Atomic uint64_t sequence;
+    uint64_t frame; // frames completed by the emulator when this one was taken
+    uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH];
+    uint8_t wram[SHM_EXPORT_WRAM_SIZE];
+} SHM_EXPORT_SLOT;
+
+/* Layout of the shared memory segment. Frames are written to the slots in 
+   turn so a reader working on the latest one in place has a whole frame of
+   time before the writer gets back to it. */
+typedef struct SHM_EXPORT_REGION {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    _Atomic uint64_t latest; // frame number of the last complete slot, 0 before the first
+    SHM_EXPORT_SLOT slots[SHM_EXPORT_SLOTS];
+} SHM_EXPORT_REGION;
+
+/* Writer side, owned by the emulator. The PPU output is collected in pixels 
+   and published when the last pixel of the frame is drawn. */
+typedef struct SHM_EXPORT {
+    SHM_EXPORT_REGION *region;
+    char name[64];
+    uint64_t frame;
+    uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH];
+} SHM_EXPORT;
+
+bool shm_export_open(SHM_EXPORT *exp, const char *name);
+void shm_export_publish(SHM_EXPORT *exp, const uint8_t *wram);
+void shm_export_close(SHM_EXPORT *exp);
+
+const SHM_EXPORT_REGION *shm_export_attach(const char *name);
+void shm_export_detach(const SHM_EXPORT_REGION *region);
+const SHM_EXPORT_SLOT *shm_export_read_begin(const SHM_EXPORT_REGION *region, uint64_t *sequence);
+bool shm_export_read_end(const SHM_EXPORT_SLOT *slot, uint64_t sequence);
+
+#endif
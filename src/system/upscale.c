@@ -0,0 +1,464 @@
+#include <string.h>
+
+#include "upscale.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UPSCALE_X86
+#include <immintrin.h>
+#endif
+
+#define PADDED_WIDTH (WINDOW_WIDTH + 2)
+
+static const char *filter_names[UPSCALE_FILTERS] = { "none", "nearest", "scale2x", "scale3x", "xbr" };
+static const char *isa_names[UPSCALE_ISAS] = { "scalar", "sse2", "avx2" };
+
+
+/* Returns the widest instruction set the CPU supports */
+UPSCALE_ISA upscale_best_isa(void){
+#ifdef UPSCALE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return UPSCALE_AVX2;
+    if(__builtin_cpu_supports("sse2")) return UPSCALE_SSE2;
+#endif
+    return UPSCALE_SCALAR; // elsewhere the scalar kernels are left to the auto vectorizer
+}
+
+
+
+void upscaler_init(UPSCALER *up, UPSCALE_FILTER filter){
+    up->filter = filter;
+    up->isa    = upscale_best_isa();
+}
+
+
+
+/* Forces the instruction set used by the kernels (to compare them). Returns
+   false if the CPU does not support it. */
+bool upscaler_set_isa(UPSCALER *up, UPSCALE_ISA isa){
+    if(isa > upscale_best_isa()) return false;
+    up->isa = isa;
+    return true;
+}
+
+
+
+int upscaler_factor(const UPSCALER *up){
+    switch(up->filter){
+        case UPSCALE_NEAREST: return SCALE_FACTOR;
+        case UPSCALE_SCALE2X: return 2;
+        case UPSCALE_SCALE3X: return 3;
+        case UPSCALE_XBR:     return 2;
+        default:              return 1;
+    }
+}
+
+
+
+bool upscale_parse_filter(const char *name, UPSCALE_FILTER *filter){
+    for(int i = 0; i < UPSCALE_FILTERS; i++){
+        if(strcmp(name, filter_names[i]) == 0){
+            *filter = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *upscale_filter_name(UPSCALE_FILTER filter){
+    return filter < UPSCALE_FILTERS ? filter_names[filter] : "?";
+}
+
+const char *upscale_isa_name(UPSCALE_ISA isa){
+    return isa < UPSCALE_ISAS ? isa_names[isa] : "?";
+}
+
+
+
+/* Copies the frame inside the padded buffer, the border repeats the edge pixels */
+static void pad_frame(UPSCALER *up, const uint32_t *frame, int frame_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        uint32_t *row = &up->padded[(y + 1) * PADDED_WIDTH];
+        memcpy(row + 1, &frame[y * frame_pitch], WINDOW_WIDTH * sizeof(uint32_t));
+        row[0] = row[1];
+        row[WINDOW_WIDTH + 1] = row[WINDOW_WIDTH];
+    }
+    memcpy(up->padded, &up->padded[PADDED_WIDTH], PADDED_WIDTH * sizeof(uint32_t));
+    memcpy(&up->padded[(WINDOW_HEIGHT + 1) * PADDED_WIDTH], &up->padded[WINDOW_HEIGHT * PADDED_WIDTH], PADDED_WIDTH * sizeof(uint32_t));
+}
+
+
+
+/*
+ * Scalar kernels. Around the pixel E the neighbours are named
+ *      A B C
+ *      D E F
+ *      G H I
+ * and they are the reference for the vector ones, that produce the same output.
+ */
+
+static void nearest_scalar(const uint32_t *frame, int frame_pitch, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        uint32_t *dst = &out[y * SCALE_FACTOR * out_pitch];
+        for(int x = 0; x < WINDOW_WIDTH; x++){
+            for(int i = 0; i < SCALE_FACTOR; i++) dst[x * SCALE_FACTOR + i] = frame[y * frame_pitch + x];
+        }
+        for(int i = 1; i < SCALE_FACTOR; i++){
+            memcpy(&dst[i * out_pitch], dst, WINDOW_WIDTH * SCALE_FACTOR * sizeof(uint32_t));
+        }
+    }
+}
+
+static void scale2x_scalar(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x++, p++){
+            uint32_t B = p[-PADDED_WIDTH], D = p[-1], E = p[0], F = p[1], H = p[PADDED_WIDTH];
+            bool edge = B != H && D != F;
+            dst0[2 * x]     = edge && D == B ? D : E;
+            dst0[2 * x + 1] = edge && B == F ? F : E;
+            dst1[2 * x]     = edge && D == H ? D : E;
+            dst1[2 * x + 1] = edge && H == F ? F : E;
+        }
+    }
+}
+
+static void scale3x_scalar(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(3 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+        uint32_t *dst2 = dst1 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x++, p++){
+            uint32_t A = p[-PADDED_WIDTH - 1], B = p[-PADDED_WIDTH], C = p[-PADDED_WIDTH + 1];
+            uint32_t D = p[-1],                E = p[0],             F = p[1];
+            uint32_t G = p[PADDED_WIDTH - 1],  H = p[PADDED_WIDTH],  I = p[PADDED_WIDTH + 1];
+            bool edge = B != H && D != F;
+            bool db = edge && D == B, bf = edge && B == F, dh = edge && D == H, hf = edge && H == F;
+
+            dst0[3 * x]     = db ? D : E;
+            dst0[3 * x + 1] = (db && E != C) || (bf && E != A) ? B : E;
+            dst0[3 * x + 2] = bf ? F : E;
+            dst1[3 * x]     = (db && E != G) || (dh && E != A) ? D : E;
+            dst1[3 * x + 1] = E;
+            dst1[3 * x + 2] = (bf && E != I) || (hf && E != C) ? F : E;
+            dst2[3 * x]     = dh ? D : E;
+            dst2[3 * x + 1] = (dh && E != I) || (hf && E != G) ? H : E;
+            dst2[3 * x + 2] = hf ? F : E;
+        }
+    }
+}
+
+
+
+/* Sum of the absolute differences of the four channels */
+static inline int pixel_distance(uint32_t a, uint32_t b){
+    int d = 0;
+    for(int i = 0; i < 32; i += 8){
+        int ca = (a >> i) & 0xFF, cb = (b >> i) & 0xFF;
+        d += ca > cb ? ca - cb : cb - ca;
+    }
+    return d;
+}
+
+/* Rounded up average of each channel, as the SIMD average instructions do */
+static inline uint32_t pixel_average(uint32_t a, uint32_t b){
+    return (a | b) - (((a ^ b) >> 1) & 0x7F7F7F7F);
+}
+
+/* One corner of the light xBR: E is the pixel, X and Y the two neighbours
+   next to the corner, Z the diagonal one, P and Q the neighbours across the
+   other diagonal of X and Y, U and V the pixels at the ends of the X-Y edge.
+   When the X-Y edge is more continuous than the E-Z one the corner is
+   blended with the closest of X and Y. */
+static inline uint32_t xbr_corner(uint32_t E, uint32_t X, uint32_t Y, uint32_t Z,
+                                  uint32_t P, uint32_t Q, uint32_t U, uint32_t V){
+    int edge_xy = pixel_distance(E, U) + pixel_distance(E, V) + 4 * pixel_distance(X, Y);
+    int edge_ez = pixel_distance(X, P) + pixel_distance(Y, Q) + 4 * pixel_distance(E, Z);
+    if(edge_xy >= edge_ez) return E;
+    return pixel_average(E, pixel_distance(E, X) <= pixel_distance(E, Y) ? X : Y);
+}
+
+static void xbr_scalar(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x++, p++){
+            uint32_t A = p[-PADDED_WIDTH - 1], B = p[-PADDED_WIDTH], C = p[-PADDED_WIDTH + 1];
+            uint32_t D = p[-1],                E = p[0],             F = p[1];
+            uint32_t G = p[PADDED_WIDTH - 1],  H = p[PADDED_WIDTH],  I = p[PADDED_WIDTH + 1];
+
+            dst0[2 * x]     = xbr_corner(E, D, B, A, H, F, G, C);
+            dst0[2 * x + 1] = xbr_corner(E, F, B, C, H, D, I, A);
+            dst1[2 * x]     = xbr_corner(E, D, H, G, B, F, A, I);
+            dst1[2 * x + 1] = xbr_corner(E, F, H, I, B, D, C, G);
+        }
+    }
+}
+
+
+
+#ifdef UPSCALE_X86
+
+/*
+ * SSE2 kernels, 4 pixels at a time. 160 is a multiple of 8 so the rows
+ * have no remainder.
+ */
+
+#define SSE_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define SSE_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+
+static inline __m128i sse_select(__m128i mask, __m128i a, __m128i b){
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i sse_not_equal(__m128i a, __m128i b){
+    return _mm_xor_si128(_mm_cmpeq_epi32(a, b), _mm_set1_epi32(-1));
+}
+
+/* Writes a0 b0 a1 b1 a2 b2 a3 b3 */
+static inline void sse_store_interleaved2(uint32_t *dst, __m128i a, __m128i b){
+    SSE_STORE(dst,     _mm_unpacklo_epi32(a, b));
+    SSE_STORE(dst + 4, _mm_unpackhi_epi32(a, b));
+}
+
+/* Writes a0 b0 c0 a1 b1 c1 a2 b2 c2 a3 b3 c3 */
+static inline void sse_store_interleaved3(uint32_t *dst, __m128i a, __m128i b, __m128i c){
+    __m128 ab_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b)); // a0 b0 a1 b1
+    __m128 ab_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b)); // a2 b2 a3 b3
+    __m128 ca_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a)); // c0 a0 c1 a1
+    __m128 ca_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a)); // c2 a2 c3 a3
+    __m128 bc_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c)); // b0 c0 b1 c1
+    __m128 bc_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c)); // b2 c2 b3 c3
+
+    _mm_storeu_ps((float *)dst,     _mm_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3, 0, 1, 0)));
+    _mm_storeu_ps((float *)dst + 4, _mm_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1, 0, 3, 2)));
+    _mm_storeu_ps((float *)dst + 8, _mm_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3, 2, 3, 0)));
+}
+
+static void scale2x_sse2(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x += 4, p += 4){
+            __m128i B = SSE_LOAD(p - PADDED_WIDTH), D = SSE_LOAD(p - 1), E = SSE_LOAD(p);
+            __m128i F = SSE_LOAD(p + 1), H = SSE_LOAD(p + PADDED_WIDTH);
+            __m128i edge = _mm_and_si128(sse_not_equal(B, H), sse_not_equal(D, F));
+
+            __m128i e0 = sse_select(_mm_and_si128(edge, _mm_cmpeq_epi32(D, B)), D, E);
+            __m128i e1 = sse_select(_mm_and_si128(edge, _mm_cmpeq_epi32(B, F)), F, E);
+            __m128i e2 = sse_select(_mm_and_si128(edge, _mm_cmpeq_epi32(D, H)), D, E);
+            __m128i e3 = sse_select(_mm_and_si128(edge, _mm_cmpeq_epi32(H, F)), F, E);
+
+            sse_store_interleaved2(&dst0[2 * x], e0, e1);
+            sse_store_interleaved2(&dst1[2 * x], e2, e3);
+        }
+    }
+}
+
+static void scale3x_sse2(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(3 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+        uint32_t *dst2 = dst1 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x += 4, p += 4){
+            __m128i A = SSE_LOAD(p - PADDED_WIDTH - 1), B = SSE_LOAD(p - PADDED_WIDTH), C = SSE_LOAD(p - PADDED_WIDTH + 1);
+            __m128i D = SSE_LOAD(p - 1),                E = SSE_LOAD(p),                F = SSE_LOAD(p + 1);
+            __m128i G = SSE_LOAD(p + PADDED_WIDTH - 1), H = SSE_LOAD(p + PADDED_WIDTH), I = SSE_LOAD(p + PADDED_WIDTH + 1);
+            __m128i edge = _mm_and_si128(sse_not_equal(B, H), sse_not_equal(D, F));
+            __m128i db = _mm_and_si128(edge, _mm_cmpeq_epi32(D, B));
+            __m128i bf = _mm_and_si128(edge, _mm_cmpeq_epi32(B, F));
+            __m128i dh = _mm_and_si128(edge, _mm_cmpeq_epi32(D, H));
+            __m128i hf = _mm_and_si128(edge, _mm_cmpeq_epi32(H, F));
+
+            __m128i e0 = sse_select(db, D, E);
+            __m128i e1 = sse_select(_mm_or_si128(_mm_and_si128(db, sse_not_equal(E, C)), _mm_and_si128(bf, sse_not_equal(E, A))), B, E);
+            __m128i e2 = sse_select(bf, F, E);
+            __m128i e3 = sse_select(_mm_or_si128(_mm_and_si128(db, sse_not_equal(E, G)), _mm_and_si128(dh, sse_not_equal(E, A))), D, E);
+            __m128i e5 = sse_select(_mm_or_si128(_mm_and_si128(bf, sse_not_equal(E, I)), _mm_and_si128(hf, sse_not_equal(E, C))), F, E);
+            __m128i e6 = sse_select(dh, D, E);
+            __m128i e7 = sse_select(_mm_or_si128(_mm_and_si128(dh, sse_not_equal(E, I)), _mm_and_si128(hf, sse_not_equal(E, G))), H, E);
+            __m128i e8 = sse_select(hf, F, E);
+
+            sse_store_interleaved3(&dst0[3 * x], e0, e1, e2);
+            sse_store_interleaved3(&dst1[3 * x], e3, E, e5);
+            sse_store_interleaved3(&dst2[3 * x], e6, e7, e8);
+        }
+    }
+}
+
+static inline __m128i sse_distance(__m128i a, __m128i b){
+    __m128i diff  = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    __m128i low   = _mm_set1_epi32(0x00FF00FF);
+    __m128i pairs = _mm_add_epi32(_mm_and_si128(diff, low), _mm_and_si128(_mm_srli_epi32(diff, 8), low));
+    return _mm_add_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(pairs, 16));
+}
+
+static inline __m128i sse_xbr_corner(__m128i E, __m128i X, __m128i Y, __m128i Z,
+                                     __m128i P, __m128i Q, __m128i U, __m128i V){
+    __m128i edge_xy = _mm_add_epi32(_mm_add_epi32(sse_distance(E, U), sse_distance(E, V)), _mm_slli_epi32(sse_distance(X, Y), 2));
+    __m128i edge_ez = _mm_add_epi32(_mm_add_epi32(sse_distance(X, P), sse_distance(Y, Q)), _mm_slli_epi32(sse_distance(E, Z), 2));
+    __m128i closest = sse_select(_mm_cmpgt_epi32(sse_distance(E, X), sse_distance(E, Y)), Y, X);
+    return sse_select(_mm_cmplt_epi32(edge_xy, edge_ez), _mm_avg_epu8(E, closest), E);
+}
+
+static void xbr_sse2(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x += 4, p += 4){
+            __m128i A = SSE_LOAD(p - PADDED_WIDTH - 1), B = SSE_LOAD(p - PADDED_WIDTH), C = SSE_LOAD(p - PADDED_WIDTH + 1);
+            __m128i D = SSE_LOAD(p - 1),                E = SSE_LOAD(p),                F = SSE_LOAD(p + 1);
+            __m128i G = SSE_LOAD(p + PADDED_WIDTH - 1), H = SSE_LOAD(p + PADDED_WIDTH), I = SSE_LOAD(p + PADDED_WIDTH + 1);
+
+            sse_store_interleaved2(&dst0[2 * x], sse_xbr_corner(E, D, B, A, H, F, G, C), sse_xbr_corner(E, F, B, C, H, D, I, A));
+            sse_store_interleaved2(&dst1[2 * x], sse_xbr_corner(E, D, H, G, B, F, A, I), sse_xbr_corner(E, F, H, I, B, D, C, G));
+        }
+    }
+}
+
+
+
+/*
+ * AVX2 kernels, 8 pixels at a time. The unpack instructions work inside
+ * each 128 bit lane so the interleaved halves are put back in order with a
+ * lane permute. Scale3x keeps the SSE2 kernel: its three way interleave
+ * across lanes costs more than the wider compares save.
+ */
+
+#define AVX_TARGET __attribute__((target("avx2")))
+#define AVX_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define AVX_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+AVX_TARGET static inline __m256i avx_select(__m256i mask, __m256i a, __m256i b){
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+AVX_TARGET static inline __m256i avx_not_equal(__m256i a, __m256i b){
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(a, b), _mm256_set1_epi32(-1));
+}
+
+AVX_TARGET static inline void avx_store_interleaved2(uint32_t *dst, __m256i a, __m256i b){
+    __m256i lo = _mm256_unpacklo_epi32(a, b); // a0 b0 a1 b1 | a4 b4 a5 b5
+    __m256i hi = _mm256_unpackhi_epi32(a, b); // a2 b2 a3 b3 | a6 b6 a7 b7
+    AVX_STORE(dst,     _mm256_permute2x128_si256(lo, hi, 0x20));
+    AVX_STORE(dst + 8, _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+AVX_TARGET static void scale2x_avx2(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x += 8, p += 8){
+            __m256i B = AVX_LOAD(p - PADDED_WIDTH), D = AVX_LOAD(p - 1), E = AVX_LOAD(p);
+            __m256i F = AVX_LOAD(p + 1), H = AVX_LOAD(p + PADDED_WIDTH);
+            __m256i edge = _mm256_and_si256(avx_not_equal(B, H), avx_not_equal(D, F));
+
+            __m256i e0 = avx_select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(D, B)), D, E);
+            __m256i e1 = avx_select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(B, F)), F, E);
+            __m256i e2 = avx_select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(D, H)), D, E);
+            __m256i e3 = avx_select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(H, F)), F, E);
+
+            avx_store_interleaved2(&dst0[2 * x], e0, e1);
+            avx_store_interleaved2(&dst1[2 * x], e2, e3);
+        }
+    }
+}
+
+AVX_TARGET static inline __m256i avx_distance(__m256i a, __m256i b){
+    __m256i diff  = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+    __m256i low   = _mm256_set1_epi32(0x00FF00FF);
+    __m256i pairs = _mm256_add_epi32(_mm256_and_si256(diff, low), _mm256_and_si256(_mm256_srli_epi32(diff, 8), low));
+    return _mm256_add_epi32(_mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(pairs, 16));
+}
+
+AVX_TARGET static inline __m256i avx_xbr_corner(__m256i E, __m256i X, __m256i Y, __m256i Z,
+                                                __m256i P, __m256i Q, __m256i U, __m256i V){
+    __m256i edge_xy = _mm256_add_epi32(_mm256_add_epi32(avx_distance(E, U), avx_distance(E, V)), _mm256_slli_epi32(avx_distance(X, Y), 2));
+    __m256i edge_ez = _mm256_add_epi32(_mm256_add_epi32(avx_distance(X, P), avx_distance(Y, Q)), _mm256_slli_epi32(avx_distance(E, Z), 2));
+    __m256i closest = avx_select(_mm256_cmpgt_epi32(avx_distance(E, X), avx_distance(E, Y)), Y, X);
+    return avx_select(_mm256_cmpgt_epi32(edge_ez, edge_xy), _mm256_avg_epu8(E, closest), E);
+}
+
+AVX_TARGET static void xbr_avx2(const uint32_t *padded, uint32_t *out, int out_pitch){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        const uint32_t *p = &padded[(y + 1) * PADDED_WIDTH + 1];
+        uint32_t *dst0 = &out[(2 * y) * out_pitch];
+        uint32_t *dst1 = dst0 + out_pitch;
+
+        for(int x = 0; x < WINDOW_WIDTH; x += 8, p += 8){
+            __m256i A = AVX_LOAD(p - PADDED_WIDTH - 1), B = AVX_LOAD(p - PADDED_WIDTH), C = AVX_LOAD(p - PADDED_WIDTH + 1);
+            __m256i D = AVX_LOAD(p - 1),                E = AVX_LOAD(p),                F = AVX_LOAD(p + 1);
+            __m256i G = AVX_LOAD(p + PADDED_WIDTH - 1), H = AVX_LOAD(p + PADDED_WIDTH), I = AVX_LOAD(p + PADDED_WIDTH + 1);
+
+            avx_store_interleaved2(&dst0[2 * x], avx_xbr_corner(E, D, B, A, H, F, G, C), avx_xbr_corner(E, F, B, C, H, D, I, A));
+            avx_store_interleaved2(&dst1[2 * x], avx_xbr_corner(E, D, H, G, B, F, A, I), avx_xbr_corner(E, F, H, I, B, D, C, G));
+        }
+    }
+}
+
+#endif /* UPSCALE_X86 */
+
+
+
+/* This function scales the complete 160x144 frame into out, that must have
+   room for upscaler_factor times the frame in both directions. Pitches are
+   in pixels. */
+void upscaler_run(UPSCALER *up, const uint32_t *frame, int frame_pitch, uint32_t *out, int out_pitch){
+    if(up->filter == UPSCALE_NONE){
+        for(int y = 0; y < WINDOW_HEIGHT; y++){
+            memcpy(&out[y * out_pitch], &frame[y * frame_pitch], WINDOW_WIDTH * sizeof(uint32_t));
+        }
+        return;
+    }
+    if(up->filter == UPSCALE_NEAREST){
+        nearest_scalar(frame, frame_pitch, out, out_pitch); // only copies, already as fast as memory
+        return;
+    }
+
+    pad_frame(up, frame, frame_pitch);
+
+    switch(up->filter){
+        case UPSCALE_SCALE2X:
+#ifdef UPSCALE_X86
+            if(up->isa == UPSCALE_AVX2)      scale2x_avx2(up->padded, out, out_pitch);
+            else if(up->isa == UPSCALE_SSE2) scale2x_sse2(up->padded, out, out_pitch);
+            else
+#endif
+            scale2x_scalar(up->padded, out, out_pitch);
+            break;
+
+        case UPSCALE_SCALE3X:
+#ifdef UPSCALE_X86
+            if(up->isa >= UPSCALE_SSE2) scale3x_sse2(up->padded, out, out_pitch);
+            else
+#endif
+            scale3x_scalar(up->padded, out, out_pitch);
+            break;
+
+        case UPSCALE_XBR:
+#ifdef UPSCALE_X86
+            if(up->isa == UPSCALE_AVX2)      xbr_avx2(up->padded, out, out_pitch);
+            else if(up->isa == UPSCALE_SSE2) xbr_sse2(up->padded, out, out_pitch);
+            else
+#endif
+            xbr_scalar(up->padded, out, out_pitch);
+            break;
+
+        default:
+            break;
+    }
+}
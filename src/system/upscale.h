@@ -0,0 +1,48 @@
+#ifndef UPSCALE_H
+#define UPSCALE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../hardware/ppu.h"
+
+#define UPSCALE_MAX_FACTOR SCALE_FACTOR
+
+/* Filters applied to a complete 160x144 frame. NONE leaves the frame native
+   (the GPU scales it when it is drawn), the others produce a frame factor 
+   times larger on the CPU. */
+typedef enum UPSCALE_FILTER {
+    UPSCALE_NONE,
+    UPSCALE_NEAREST, // pixel replication by SCALE_FACTOR
+    UPSCALE_SCALE2X,
+    UPSCALE_SCALE3X,
+    UPSCALE_XBR,     // 2x, light xBR: corners across a detected edge are blended
+    UPSCALE_FILTERS
+} UPSCALE_FILTER;
+
+typedef enum UPSCALE_ISA {
+    UPSCALE_SCALAR,
+    UPSCALE_SSE2,
+    UPSCALE_AVX2,
+    UPSCALE_ISAS
+} UPSCALE_ISA;
+
+/* Frames are padded with their border replicated so that the kernels never
+   check the edges */
+typedef struct UPSCALER {
+    UPSCALE_FILTER filter;
+    UPSCALE_ISA isa;
+    uint32_t padded[(WINDOW_HEIGHT + 2) * (WINDOW_WIDTH + 2)];
+} UPSCALER;
+
+void upscaler_init(UPSCALER *up, UPSCALE_FILTER filter);
+bool upscaler_set_isa(UPSCALER *up, UPSCALE_ISA isa);
+int upscaler_factor(const UPSCALER *up);
+void upscaler_run(UPSCALER *up, const uint32_t *frame, int frame_pitch, uint32_t *out, int out_pitch);
+
+UPSCALE_ISA upscale_best_isa(void);
+bool upscale_parse_filter(const char *name, UPSCALE_FILTER *filter);
+const char *upscale_filter_name(UPSCALE_FILTER filter);
+const char *upscale_isa_name(UPSCALE_ISA isa);
+
+#endif
@@ -0,0 +1,80 @@
+/* Converts a recording in the .gbv container (--record=<path>.gbv) to a raw
+   Y4M stream that ffmpeg and most players read, e.g. to make a video for a
+   bug report: ffmpeg -i out.y4m -vf scale=640:576:flags=neighbor out.mp4
+   Frames dropped while recording are filled with the previous one so the
+   video keeps the real timing. With a third argument the frame with that
+   number is also saved as PNG.
+
+   Usage: ./capture_convert <in.gbv> <out.y4m> [frame] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/system/capture.h"
+
+int main(int argc, char **argv){
+    if(argc < 3){
+        fprintf(stderr, "[ERROR] Usage: ./capture_convert <in.gbv> <out.y4m> [frame]\n");
+        return 1;
+    }
+    uint32_t png_frame = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : 0;
+
+    FILE *in = fopen(argv[1], "rb");
+    if(in == NULL){
+        fprintf(stderr, "[ERROR] Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    CAPTURE_GBV_HEADER header;
+    if(fread(&header, sizeof(header), 1, in) != 1 || header.magic != CAPTURE_GBV_MAGIC ||
+       header.version != CAPTURE_GBV_VERSION || header.width != WINDOW_WIDTH || header.height != WINDOW_HEIGHT){
+        fprintf(stderr, "[ERROR] %s is not a .gbv recording\n", argv[1]);
+        return 1;
+    }
+    FILE *out = fopen(argv[2], "wb");
+    if(out == NULL){
+        fprintf(stderr, "[ERROR] Cannot create %s\n", argv[2]);
+        return 1;
+    }
+    capture_write_y4m_header(out);
+
+    static uint8_t rle[CAPTURE_RLE_MAX];
+    static uint8_t frame[CAPTURE_FRAME_BYTES], delta[CAPTURE_FRAME_BYTES];
+    uint64_t frames = 0, filled = 0, bytes = sizeof(header);
+    uint32_t last = 0;
+    CAPTURE_GBV_FRAME fh;
+
+    while(fread(&fh, sizeof(fh), 1, in) == 1){
+        if(fh.length > sizeof(rle) || fread(rle, fh.length, 1, in) != 1 ||
+           !capture_rle_decode(rle, fh.length, delta, CAPTURE_FRAME_BYTES) || (frames == 0 && !(fh.flags & CAPTURE_GBV_KEY))){
+            fprintf(stderr, "[ERROR] Corrupted frame %u after %llu frames\n", fh.frame, (unsigned long long)frames);
+            break;
+        }
+        bytes += sizeof(fh) + fh.length;
+
+        for(uint32_t f = last + 1; frames > 0 && f < fh.frame; f++){
+            capture_write_y4m_frame(out, frame);
+            filled++;
+        }
+        if(fh.flags & CAPTURE_GBV_KEY) memcpy(frame, delta, CAPTURE_FRAME_BYTES);
+        else for(int i = 0; i < CAPTURE_FRAME_BYTES; i++) frame[i] ^= delta[i];
+
+        capture_write_y4m_frame(out, frame);
+        if(fh.frame == png_frame){
+            char path[64];
+            snprintf(path, sizeof(path), "frame-%06u.png", fh.frame);
+            if(capture_write_png(path, frame)) printf("[INFO] Frame %u saved to %s\n", fh.frame, path);
+        }
+        last = fh.frame;
+        frames++;
+    }
+
+    fclose(in);
+    if(fclose(out) != 0){
+        fprintf(stderr, "[ERROR] Cannot write %s\n", argv[2]);
+        return 1;
+    }
+    printf("[INFO] %llu frames (%llu filled in), %.1f bytes per frame in the .gbv against %d packed\n",
+           (unsigned long long)frames, (unsigned long long)filled, frames ? (double)bytes / frames : 0.0, CAPTURE_FRAME_BYTES);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/* Control protocol benchmark: a headless emulator in a child process serves
+   the control socket, the parent is the controller. Measures the round trip
+   of a command that does not run frames, the step+observe loop (STEP 1 then
+   FRAME_HASH) one at a time and with many requests in flight, and a save/load
+   state pair.
+
+   Usage: ./control_bench <path-to-ROM> [iterations] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../src/hardware/emulator.h"
+#include "../src/system/control.h"
+#include "../src/system/pacing.h"
+
+static CONTROL control;
+static EMULATOR emu;
+static CARTRIDGE cartridge;
+static FRAME_HISTOGRAM latency;
+
+static uint8_t state[EMULATOR_STATE_SIZE];
+
+static void hash_frame_buffer(int x, int y, uint8_t color){
+    control_pixel(&control, x, y, color);
+}
+
+
+
+/* Child: the same loop as the headless runner */
+static void serve(const char *path){
+    if(!control_listen(&control, path, true)) exit(1);
+    emulator_init(&emu, &cartridge, hash_frame_buffer);
+
+    while(emu.cpu.running && control_service(&control, &emu, true)){
+        emulator_run(&emu, 0, CYCLES_PER_FRAME);
+        joypad_apply_events(UINT32_MAX);
+        control_frame_done(&control);
+    }
+    control_close(&control);
+    exit(0);
+}
+
+
+
+static bool write_all(int fd, const void *buf, size_t len){
+    const uint8_t *p = buf;
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len){
+    uint8_t *p = buf;
+    while(len > 0){
+        ssize_t n = read(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void send_request(int fd, uint8_t op, uint32_t arg0, const void *payload, uint32_t length){
+    CONTROL_REQUEST req = { .op = op, .arg0 = arg0, .length = length };
+    if(!write_all(fd, &req, sizeof(req)) || (length > 0 && !write_all(fd, payload, length))){
+        fprintf(stderr, "[ERROR] Control socket closed\n");
+        exit(1);
+    }
+}
+
+/* Reads one reply, the payload goes in buf (that must be big enough) */
+static CONTROL_REPLY read_reply(int fd, void *buf){
+    CONTROL_REPLY reply;
+    if(!read_all(fd, &reply, sizeof(reply)) || (reply.length > 0 && !read_all(fd, buf, reply.length))){
+        fprintf(stderr, "[ERROR] Control socket closed\n");
+        exit(1);
+    }
+    return reply;
+}
+
+static int connect_to(const char *path){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    for(int i = 0; i < 100; i++){
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static void print_latency(const char *name, int count, uint64_t elapsed){
+    printf("%-28s %8.0f /s   p50 %6.1f us   p99 %6.1f us   max %7.1f us\n", name, count / (elapsed / 1e9),
+           histogram_percentile(&latency, 50) / 1e3, histogram_percentile(&latency, 99) / 1e3, latency.max_ns / 1e3);
+}
+
+
+
+/* Keeps depth requests (STEP 1 + FRAME_HASH, or FRAME_HASH alone) in flight,
+   the latency is from sending a request to reading its reply */
+static void run_pipelined(int fd, int depth, int iterations, bool step){
+    int sent = 0, received = 0;
+    uint64_t sent_at[64];
+    memset(&latency, 0, sizeof(latency));
+    uint64_t start = pacer_now_ns();
+
+    while(received < iterations){
+        while(sent < iterations && sent - received < depth){
+            sent_at[sent % depth] = pacer_now_ns();
+            if(step) send_request(fd, CONTROL_STEP, 1, NULL, 0);
+            send_request(fd, CONTROL_FRAME_HASH, 0, NULL, 0);
+            sent++;
+        }
+        if(step) read_reply(fd, NULL);
+        read_reply(fd, NULL);
+        histogram_add(&latency, pacer_now_ns() - sent_at[received % depth]);
+        received++;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s, %d in flight", step ? "step+hash" : "frame hash", depth);
+    print_latency(name, iterations, pacer_now_ns() - start);
+}
+
+
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        fprintf(stderr, "[ERROR] Usage: ./control_bench <path-to-ROM> [iterations]\n");
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+    if(!cartridge_load(&cartridge, argv[1])){
+        fprintf(stderr, "[ERROR] Cannot open ROM %s\n", argv[1]);
+        return 1;
+    }
+    InitializeInstructionTable();
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/gameboy-control-bench-%d.sock", (int)getpid());
+    fflush(stdout);
+    pid_t child = fork();
+    if(child == 0) serve(path);
+
+    int fd = connect_to(path);
+    if(fd < 0){
+        fprintf(stderr, "[ERROR] Cannot connect to %s\n", path);
+        kill(child, SIGKILL);
+        return 1;
+    }
+
+    // a command that never waits for the emulator
+    memset(&latency, 0, sizeof(latency));
+    uint64_t start = pacer_now_ns();
+    for(int i = 0; i < iterations; i++){
+        uint64_t t = pacer_now_ns();
+        send_request(fd, CONTROL_FRAME_HASH, 0, NULL, 0);
+        read_reply(fd, NULL);
+        histogram_add(&latency, pacer_now_ns() - t);
+    }
+    print_latency("frame hash round trip", iterations, pacer_now_ns() - start);
+
+    // step one frame and observe, waiting for each reply before the next request
+    memset(&latency, 0, sizeof(latency));
+    start = pacer_now_ns();
+    for(int i = 0; i < iterations; i++){
+        uint64_t t = pacer_now_ns();
+        send_request(fd, CONTROL_STEP, 1, NULL, 0);
+        send_request(fd, CONTROL_FRAME_HASH, 0, NULL, 0);
+        read_reply(fd, NULL);
+        read_reply(fd, NULL);
+        histogram_add(&latency, pacer_now_ns() - t);
+    }
+    print_latency("step+hash, one in flight", iterations, pacer_now_ns() - start);
+
+    // the same with a window of requests in flight, the emulator never waits for the controller
+    run_pipelined(fd, 8, iterations, true);
+    run_pipelined(fd, 64, iterations, true);
+    run_pipelined(fd, 64, iterations * 10, false);
+
+    // save and load back the whole state
+    memset(&latency, 0, sizeof(latency));
+    int states = iterations / 10;
+    start = pacer_now_ns();
+    for(int i = 0; i < states; i++){
+        uint64_t t = pacer_now_ns();
+        send_request(fd, CONTROL_SAVE_STATE, 0, NULL, 0);
+        CONTROL_REPLY saved = read_reply(fd, state);
+        send_request(fd, CONTROL_LOAD_STATE, 0, state, saved.length);
+        if(read_reply(fd, NULL).status != CONTROL_OK) fprintf(stderr, "[ERROR] State not loaded\n");
+        histogram_add(&latency, pacer_now_ns() - t);
+    }
+    print_latency("save+load state", states, pacer_now_ns() - start);
+
+    send_request(fd, CONTROL_QUIT, 0, NULL, 0);
+    read_reply(fd, NULL);
+    close(fd);
+    waitpid(child, NULL, 0);
+    cartridge_unload(&cartridge);
+    return 0;
+}
@@ -0,0 +1,382 @@
+/* Finds the first instruction where two execution traces diverge, e.g. ours
+   against the log of a reference emulator. Each trace can be a binary trace
+   (--trace=<path>) or a text log, either in the format of GetEmulatorStatus
+   (the old gameboy.log) or in the gameboy-doctor one. Both files are mapped
+   and compared by several threads, each taking the next chunk of records.
+   Text logs whose lines all have the same length are addressed directly,
+   the others are indexed first, also in parallel. The marker records of a
+   binary trace are not instructions, where they are is noted first and the
+   instructions are addressed around them. The first divergent
+   instruction is printed with the lines before it and the registers that
+   differ. Exits with 0 when the traces match and 1 when they diverge.
+
+   Usage: ./gbtrace_diff [--context=N] [--threads=N] <ours> <reference> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/hardware/trace.h"
+#include "../src/system/pacing.h"
+
+#define MAX_THREADS   64
+#define CHUNK_RECORDS 65536
+
+/* A trace mapped in memory */
+typedef struct SOURCE {
+    const char *path;
+    const uint8_t *data;
+    size_t size;
+    bool binary;
+    size_t line_len;   // text with lines all this long, 0 otherwise
+    uint64_t *lines;   // text: offset of every line and the end of the file, when line_len is 0
+    uint64_t *markers; // binary: instruction each marker record comes before, in order
+    uint64_t marker_count;
+    uint64_t count;    // instructions or lines
+} SOURCE;
+
+/* Work of a thread while indexing a text log */
+typedef struct INDEX_JOB {
+    const SOURCE *src;
+    size_t start, end; // bytes
+    uint64_t newlines;
+    uint64_t first;    // index of the first line starting in the range
+    bool fixed;        // every newline of the range is at a multiple of line_len
+    pthread_t thread;
+} INDEX_JOB;
+
+static SOURCE ours, reference;
+static int thread_count;
+static _Atomic uint64_t next_chunk;
+static _Atomic uint64_t divergence; // first record that differs, UINT64_MAX when none
+
+
+static bool map_source(SOURCE *src, const char *path){
+    src->path = path;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0){
+        fprintf(stderr, "[ERROR] Cannot open %s\n", path);
+        return false;
+    }
+    src->size = st.st_size;
+    if(src->size > 0){
+        src->data = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(src->data == MAP_FAILED){
+            fprintf(stderr, "[ERROR] Cannot map %s\n", path);
+            close(fd);
+            return false;
+        }
+        madvise((void*)src->data, src->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    TRACE_HEADER header;
+    if(src->size >= sizeof(header)){
+        memcpy(&header, src->data, sizeof(header));
+        src->binary = header.magic == TRACE_MAGIC;
+        if(src->binary && (header.version != TRACE_VERSION || header.record_size != sizeof(TRACE_RECORD))){
+            fprintf(stderr, "[ERROR] %s is a trace of another version\n", path);
+            return false;
+        }
+    }
+    if(src->binary) src->count = (src->size - sizeof(header)) / sizeof(TRACE_RECORD);
+    return true;
+}
+
+
+
+static bool is_marker(const SOURCE *src, uint64_t record){
+    TRACE_RECORD r;
+    memcpy(&r, src->data + sizeof(TRACE_HEADER) + record * sizeof(TRACE_RECORD), sizeof(TRACE_RECORD));
+    return (r.af & TRACE_DELTA_MASK) == TRACE_MARKER;
+}
+
+/* Notes where the markers of a binary trace are, they only come at the start
+   and after the gaps left by a filter so there are few */
+static bool index_markers(SOURCE *src){
+    uint64_t records = src->count;
+    for(uint64_t i = 0; i < records; i++) src->marker_count += is_marker(src, i);
+    if(src->marker_count == 0) return true;
+
+    src->markers = malloc(src->marker_count * sizeof(uint64_t));
+    if(src->markers == NULL){
+        fprintf(stderr, "[ERROR] Not enough memory to index %s\n", src->path);
+        return false;
+    }
+    uint64_t found = 0;
+    for(uint64_t i = 0; i < records; i++){
+        if(is_marker(src, i)){
+            src->markers[found] = i - found;
+            found++;
+        }
+    }
+    src->count = records - found;
+    return true;
+}
+
+/* Record of the binary trace holding instruction i, past the markers before it */
+static uint64_t record_of(const SOURCE *src, uint64_t i){
+    uint64_t low = 0, high = src->marker_count;
+    while(low < high){
+        uint64_t mid = (low + high) / 2;
+        if(src->markers[mid] <= i) low = mid + 1;
+        else high = mid;
+    }
+    return i + low;
+}
+
+
+
+static void *count_lines(void *arg){
+    INDEX_JOB *job = arg;
+    const uint8_t *p = job->src->data + job->start, *end = job->src->data + job->end;
+    size_t line_len = job->src->line_len;
+    job->fixed = line_len > 0;
+    while((p = memchr(p, '\n', end - p)) != NULL){
+        if(job->fixed && (p - job->src->data + 1) % line_len != 0) job->fixed = false;
+        job->newlines++;
+        p++;
+    }
+    return NULL;
+}
+
+static void *fill_lines(void *arg){
+    INDEX_JOB *job = arg;
+    const uint8_t *data = job->src->data, *p = data + job->start, *end = data + job->end;
+    uint64_t *lines = job->src->lines + job->first;
+    while((p = memchr(p, '\n', end - p)) != NULL){
+        p++;
+        *lines++ = p - data;
+    }
+    return NULL;
+}
+
+/* Counts the lines of a text log, with a second pass that stores where each
+   one starts when they are not all as long as the first */
+static bool index_source(SOURCE *src){
+    if(src->size == 0) return true;
+    const uint8_t *first_newline = memchr(src->data, '\n', src->size);
+    src->line_len = first_newline != NULL ? first_newline - src->data + 1 : 0;
+
+    static INDEX_JOB jobs[MAX_THREADS];
+    for(int i = 0; i < thread_count; i++){
+        jobs[i] = (INDEX_JOB){ .src = src, .start = src->size / thread_count * i,
+                               .end = i == thread_count - 1 ? src->size : src->size / thread_count * (i + 1) };
+        pthread_create(&jobs[i].thread, NULL, count_lines, &jobs[i]);
+    }
+    uint64_t newlines = 0;
+    bool fixed = src->size % (src->line_len ? src->line_len : 1) == 0;
+    for(int i = 0; i < thread_count; i++){
+        pthread_join(jobs[i].thread, NULL);
+        jobs[i].first = newlines + 1; // line 0 starts at the beginning of the file
+        newlines += jobs[i].newlines;
+        fixed = fixed && jobs[i].fixed;
+    }
+    bool unterminated = src->data[src->size - 1] != '\n';
+    src->count = newlines + unterminated;
+    if(fixed && !unterminated && newlines == src->size / src->line_len) return true;
+
+    src->line_len = 0;
+    src->lines = malloc((newlines + 2) * sizeof(uint64_t));
+    if(src->lines == NULL){
+        fprintf(stderr, "[ERROR] Not enough memory to index %s\n", src->path);
+        return false;
+    }
+    src->lines[0] = 0;
+    for(int i = 0; i < thread_count; i++) pthread_create(&jobs[i].thread, NULL, fill_lines, &jobs[i]);
+    for(int i = 0; i < thread_count; i++) pthread_join(jobs[i].thread, NULL);
+    src->lines[src->count] = src->size;
+    return true;
+}
+
+
+
+static const char *line_of(const SOURCE *src, uint64_t i, size_t *len){
+    uint64_t start = src->line_len ? i * src->line_len : src->lines[i];
+    uint64_t end   = src->line_len ? start + src->line_len : src->lines[i + 1];
+    while(end > start && (src->data[end - 1] == '\n' || src->data[end - 1] == '\r')) end--;
+    *len = end - start;
+    return (const char*)src->data + start;
+}
+
+/* Reads the hexadecimal value after label, e.g. "SP:" or "SP: ", skipping a
+   bank prefix ("00:") when there is one. Returns false if it is not there. */
+static bool field(const char **p, const char *end, const char *label, uint16_t *value){
+    size_t label_len = strlen(label);
+    while(*p + label_len <= end && memcmp(*p, label, label_len) != 0) (*p)++;
+    if(*p + label_len > end) return false;
+    *p += label_len;
+    while(*p < end && **p == ' ') (*p)++;
+
+    uint32_t v = 0;
+    int digits = 0;
+    for(; *p < end; (*p)++, digits++){
+        char c = **p;
+        if(c >= '0' && c <= '9') v = v << 4 | (c - '0');
+        else if(c >= 'A' && c <= 'F') v = v << 4 | (c - 'A' + 10);
+        else if(c >= 'a' && c <= 'f') v = v << 4 | (c - 'a' + 10);
+        else if(c == ':' && digits > 0){ v = 0; digits = -1; } // bank:address
+        else break;
+    }
+    *value = v;
+    return digits > 0;
+}
+
+/* Parses a text line of either format into a record, F keeps its low nibble
+   clear as in the binary records */
+static bool parse_line(const char *line, size_t len, TRACE_RECORD *r){
+    static const char *const labels[] = { "A:", "F:", "B:", "C:", "D:", "E:", "H:", "L:" };
+    const char *p = line, *end = line + len;
+    uint16_t regs[8], mem;
+    for(int i = 0; i < 8; i++){
+        if(!field(&p, end, labels[i], &regs[i])) return false;
+    }
+    if(!field(&p, end, "SP:", &r->sp) || !field(&p, end, "PC:", &r->pc)) return false;
+    r->af = regs[0] << 8 | (regs[1] & 0xF0);
+    r->bc = regs[2] << 8 | regs[3];
+    r->de = regs[4] << 8 | regs[5];
+    r->hl = regs[6] << 8 | regs[7];
+
+    // the bytes at PC are "(00 C3 13 02)" or "PCMEM:00,C3,13,02"
+    while(p < end && *p != '(' && *p != ':') p++;
+    for(int i = 0; i < 4; i++){
+        if(p >= end) return false;
+        p++;
+        if(!field(&p, end, "", &mem)) return false;
+        r->mem[i] = mem;
+    }
+    return true;
+}
+
+static bool get_record(const SOURCE *src, uint64_t i, TRACE_RECORD *r){
+    if(src->binary){
+        memcpy(r, src->data + sizeof(TRACE_HEADER) + record_of(src, i) * sizeof(TRACE_RECORD), sizeof(TRACE_RECORD));
+        r->af &= 0xFFF0; // the cycles are not compared
+        return true;
+    }
+    size_t len;
+    const char *line = line_of(src, i, &len);
+    return parse_line(line, len, r);
+}
+
+static bool same_record(uint64_t i){
+    if(!ours.binary && !reference.binary){ // logs in the same format are equal byte for byte
+        size_t len_a, len_b;
+        const char *a = line_of(&ours, i, &len_a), *b = line_of(&reference, i, &len_b);
+        if(len_a == len_b && memcmp(a, b, len_a) == 0) return true;
+    }
+    TRACE_RECORD a, b;
+    bool ok_a = get_record(&ours, i, &a), ok_b = get_record(&reference, i, &b);
+    return ok_a && ok_b && memcmp(&a, &b, sizeof(TRACE_RECORD)) == 0;
+}
+
+
+
+/* Body of the compare threads, chunks are taken in order so every chunk
+   before the first divergence found is compared */
+static void *compare_thread(void *arg){
+    uint64_t count = *(const uint64_t*)arg;
+    while(true){
+        uint64_t start = atomic_fetch_add(&next_chunk, 1) * CHUNK_RECORDS;
+        if(start >= count || start >= atomic_load(&divergence)) break;
+        uint64_t end = start + CHUNK_RECORDS < count ? start + CHUNK_RECORDS : count;
+        for(uint64_t i = start; i < end; i++){
+            if(same_record(i)) continue;
+            uint64_t found = atomic_load(&divergence);
+            while(i < found && !atomic_compare_exchange_weak(&divergence, &found, i));
+            break;
+        }
+    }
+    return NULL;
+}
+
+
+
+static void print_line(const char *name, const SOURCE *src, uint64_t i){
+    if(i >= src->count){
+        printf("  %-9s %10llu  (trace ended)\n", name, (unsigned long long)i);
+        return;
+    }
+    char buf[128];
+    const char *line;
+    size_t len;
+    if(src->binary){
+        TRACE_RECORD r;
+        get_record(src, i, &r);
+        len = trace_format_doctor(&r, buf, sizeof(buf)) - 1;
+        line = buf;
+    }
+    else line = line_of(src, i, &len);
+    printf("  %-9s %10llu  %.*s\n", name, (unsigned long long)i, (int)len, line);
+}
+
+static void print_difference(uint64_t i){
+    TRACE_RECORD a, b;
+    if(!get_record(&ours, i, &a) || !get_record(&reference, i, &b)){
+        printf("  a line could not be read as a trace\n");
+        return;
+    }
+    printf("  differs in:");
+    if(a.af >> 8 != b.af >> 8) printf(" A");
+    if((a.af & 0xFF) != (b.af & 0xFF)) printf(" F");
+    if(a.bc != b.bc) printf(" BC");
+    if(a.de != b.de) printf(" DE");
+    if(a.hl != b.hl) printf(" HL");
+    if(a.sp != b.sp) printf(" SP");
+    if(a.pc != b.pc) printf(" PC");
+    if(memcmp(a.mem, b.mem, 4) != 0) printf(" PCMEM");
+    printf("\n");
+}
+
+
+
+int main(int argc, char **argv){
+    const char *paths[2] = { NULL, NULL };
+    int context = 5, path_count = 0;
+    thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for(int i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--context=", 10) == 0) context = atoi(argv[i] + 10);
+        else if(strncmp(argv[i], "--threads=", 10) == 0) thread_count = atoi(argv[i] + 10);
+        else if(path_count < 2) paths[path_count++] = argv[i];
+    }
+    if(path_count < 2){
+        fprintf(stderr, "[ERROR] Usage: ./gbtrace_diff [--context=N] [--threads=N] <ours> <reference>\n");
+        return 2;
+    }
+    if(thread_count < 1) thread_count = 1;
+    if(thread_count > MAX_THREADS) thread_count = MAX_THREADS;
+    if(context < 0) context = 0;
+
+    uint64_t start = pacer_now_ns();
+    if(!map_source(&ours, paths[0]) || !map_source(&reference, paths[1])) return 2;
+    if(!(ours.binary ? index_markers(&ours) : index_source(&ours)) ||
+       !(reference.binary ? index_markers(&reference) : index_source(&reference))) return 2;
+
+    uint64_t count = ours.count < reference.count ? ours.count : reference.count;
+    atomic_init(&next_chunk, 0);
+    atomic_init(&divergence, UINT64_MAX);
+    pthread_t threads[MAX_THREADS];
+    for(int i = 0; i < thread_count; i++) pthread_create(&threads[i], NULL, compare_thread, &count);
+    for(int i = 0; i < thread_count; i++) pthread_join(threads[i], NULL);
+
+    uint64_t first = atomic_load(&divergence);
+    if(first == UINT64_MAX && ours.count != reference.count) first = count; // one of them goes on
+    double seconds = (pacer_now_ns() - start) / 1e9;
+
+    if(first == UINT64_MAX){
+        printf("[INFO] The traces match, %llu instructions compared in %.2f s\n", (unsigned long long)count, seconds);
+        return 0;
+    }
+    printf("[INFO] The traces diverge at instruction %llu (compared in %.2f s)\n", (unsigned long long)first, seconds);
+    for(uint64_t i = first > (uint64_t)context ? first - context : 0; i <= first; i++){
+        print_line("ours", &ours, i);
+        print_line("reference", &reference, i);
+    }
+    if(first < count) print_difference(first);
+    return 1;
+}
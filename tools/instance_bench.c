@@ -0,0 +1,163 @@
+/* Batch benchmark: many headless emulators running the same ROM on one core,
+   each advanced by one frame in turn like a batch runner would do. Reports
+   the time and the cache misses per emulated frame for a few instance counts,
+   with the instances in an arena on small pages and on huge pages. The cache
+   misses come from the hardware performance counters (Linux perf events), 
+   they are reported as n/a where those are not available.
+
+   Usage: ./instance_bench <path-to-ROM> [frames per instance] */
+
+#define _GNU_SOURCE // sched_setaffinity
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../src/hardware/emulator.h"
+#include "../src/system/arena.h"
+#include "../src/system/pacing.h"
+
+#define COUNTER_L1D  0
+#define COUNTER_LLC  1
+#define COUNTER_DTLB 2
+#define COUNTERS     3
+
+static int counter_fds[COUNTERS] = { -1, -1, -1 };
+
+/* Frame buffer callback, nothing is displayed */
+static void discard_frame_buffer(int x, int y, uint8_t color){}
+
+
+
+#ifdef __linux__
+static int open_cache_counter(uint64_t cache){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size   = sizeof(attr);
+    attr.type   = PERF_TYPE_HW_CACHE;
+    attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void counters_open(void){
+#ifdef __linux__
+    counter_fds[COUNTER_L1D]  = open_cache_counter(PERF_COUNT_HW_CACHE_L1D);
+    counter_fds[COUNTER_LLC]  = open_cache_counter(PERF_COUNT_HW_CACHE_LL);
+    counter_fds[COUNTER_DTLB] = open_cache_counter(PERF_COUNT_HW_CACHE_DTLB);
+#endif
+}
+
+static void counters_start(void){
+#ifdef __linux__
+    for(int i = 0; i < COUNTERS; i++){
+        if(counter_fds[i] < 0) continue;
+        ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/* Stops the counters and stores their values, -1 for the ones not available */
+static void counters_stop(int64_t values[COUNTERS]){
+    for(int i = 0; i < COUNTERS; i++){
+        values[i] = -1;
+#ifdef __linux__
+        uint64_t value;
+        if(counter_fds[i] < 0) continue;
+        ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if(read(counter_fds[i], &value, sizeof(value)) == sizeof(value)) values[i] = value;
+#endif
+    }
+}
+
+static void print_per_frame(int64_t value, uint64_t frames){
+    if(value < 0) printf("  %10s", "n/a");
+    else printf("  %10.1f", value / (double)frames);
+}
+
+
+
+static void run_batch(const CARTRIDGE *cart, size_t count, bool hugepages, int frames){
+    EMULATOR_ARENA arena;
+    if(!arena_create(&arena, count, hugepages)){
+        fprintf(stderr, "[ERROR] Cannot map an arena of %zu instances\n", count);
+        return;
+    }
+    for(size_t i = 0; i < count; i++){
+        emulator_init(&arena.emulators[i], cart, discard_frame_buffer);
+    }
+
+    // a first round so that the timed ones do not count the page faults
+    for(size_t i = 0; i < count; i++){
+        emulator_bind(&arena.emulators[i]);
+        emulator_run(&arena.emulators[i], 0, CYCLES_PER_FRAME);
+    }
+
+    int64_t misses[COUNTERS];
+    uint64_t start = pacer_now_ns();
+    counters_start();
+    for(int frame = 1; frame < frames; frame++){
+        for(size_t i = 0; i < count; i++){
+            emulator_bind(&arena.emulators[i]);
+            emulator_run(&arena.emulators[i], 0, CYCLES_PER_FRAME);
+        }
+    }
+    counters_stop(misses);
+    uint64_t elapsed = pacer_now_ns() - start;
+
+    uint64_t emulated = (uint64_t)count * (frames - 1);
+    printf("%9zu  %-22s  %8.1f", count, arena_pages_name(arena.pages), elapsed / 1e3 / emulated);
+    for(int i = 0; i < COUNTERS; i++) print_per_frame(misses[i], emulated);
+    printf("\n");
+
+    arena_destroy(&arena);
+}
+
+
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        fprintf(stderr, "[ERROR] Usage: ./instance_bench <path-to-ROM> [frames per instance]\n");
+        return 1;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : 30;
+    if(frames < 2) frames = 2;
+    const size_t counts[] = { 1, 16, 256, 1024 };
+
+    CARTRIDGE cart;
+    if(!cartridge_load(&cart, argv[1])){
+        fprintf(stderr, "[ERROR] Cannot open ROM %s\n", argv[1]);
+        return 1;
+    }
+    InitializeInstructionTable();
+
+#ifdef __linux__
+    // every instance on the same core, they compete for its caches
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+    counters_open();
+
+    printf("instance size %zu bytes, hot state %zu bytes\n\n", sizeof(EMULATOR), offsetof(EMULATOR, serial));
+    printf("%9s  %-22s  %8s  %10s  %10s  %10s\n", "instances", "pages", "us/frame", "L1D miss", "LLC miss", "dTLB miss");
+    for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++){
+        run_batch(&cart, counts[i], false, frames);
+        run_batch(&cart, counts[i], true, frames);
+    }
+
+    cartridge_unload(&cart);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/* Link cable benchmark: two headless emulators in two processes connected by
+   a Unix domain socket, one sends a byte as soon as the previous transfer 
+   completes, the other echoes every byte it receives. Runs the same amount of
+   emulated frames for a few quantum sizes and reports speed and transfers.
+
+   Usage: ./link_bench [frames] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../src/hardware/emulator.h"
+#include "../src/system/link_socket.h"
+#include "../src/system/pacing.h"
+
+static const uint8_t master_program[] = {
+    0x06, 0x00,       //      LD B,0
+    0x78,             // loop LD A,B
+    0xE0, 0x01,       //      LDH (SB),A
+    0x3E, 0x81,       //      LD A,0x81
+    0xE0, 0x02,       //      LDH (SC),A     start transfer on internal clock
+    0xF0, 0x02,       // wait LDH A,(SC)
+    0xCB, 0x7F,       //      BIT 7,A
+    0x20, 0xFA,       //      JR NZ,wait
+    0x04,             //      INC B
+    0x18, 0xF0        //      JR loop
+};
+
+static const uint8_t slave_program[] = {
+    0x3E, 0x80,       // loop LD A,0x80
+    0xE0, 0x02,       //      LDH (SC),A     wait for a transfer on external clock
+    0xF0, 0x02,       // wait LDH A,(SC)
+    0xCB, 0x7F,       //      BIT 7,A
+    0x20, 0xFA,       //      JR NZ,wait
+    0xF0, 0x01,       //      LDH A,(SB)
+    0xE0, 0x01,       //      LDH (SB),A     echo it in the next transfer
+    0x18, 0xF0        //      JR loop
+};
+
+static EMULATOR emu;
+static uint8_t rom_image[ROM_SIZE];
+static CARTRIDGE cartridge;
+static LINK_SOCKET link_socket;
+static SERIAL_BACKEND counting_backend;
+static uint64_t replies;
+
+static void discard_frame_buffer(int x, int y, uint8_t color){}
+
+/* Wraps the socket backend to count transfers that got a byte back from the peer */
+static int count_reply(int in){
+    if(in != SERIAL_PENDING && in != 0xFF) replies++;
+    return in;
+}
+
+static int counting_exchange(void *ctx, uint8_t out){
+    return count_reply(link_socket.backend.exchange(link_socket.backend.ctx, out));
+}
+
+static int counting_reply(void *ctx){
+    return count_reply(link_socket.backend.reply(link_socket.backend.ctx));
+}
+
+static void run_side(bool master, const char *path, int quantum, int frames){
+    bool connected = master ? link_socket_listen(&link_socket, path, quantum)
+                            : link_socket_connect(&link_socket, path, quantum);
+    if(!connected){
+        fprintf(stderr, "[ERROR] Cannot open link socket %s\n", path);
+        exit(1);
+    }
+
+    const uint8_t *program = master ? master_program : slave_program;
+    memcpy(&rom_image[0x0100], program, master ? sizeof(master_program) : sizeof(slave_program));
+    cartridge_from_buffer(&cartridge, rom_image, sizeof(rom_image));
+    emulator_init(&emu, &cartridge, discard_frame_buffer);
+    boot_rom_enabled = false;
+    emu.cpu.PC = 0x0100;
+
+    counting_backend = link_socket.backend;
+    counting_backend.exchange = counting_exchange;
+    counting_backend.reply    = counting_reply;
+    serial.backend = &counting_backend;
+
+    replies = 0;
+
+    // both sides must stop after the same synchronization or the last one finds the socket closed
+    uint64_t syncs = (uint64_t)frames * CYCLES_PER_FRAME / quantum;
+    uint64_t start = pacer_now_ns();
+    while(link_socket.syncs < syncs && link_socket.fd >= 0){
+        link_socket_run(&link_socket, &emu, 0, quantum);
+    }
+    uint64_t elapsed = pacer_now_ns() - start;
+    link_socket_close(&link_socket);
+
+    double emulated_s = syncs * (double)quantum / CLOCK_FREQ_HZ;
+    printf("%-6s quantum %7d  %8.1f ms  %6.1fx real time  %7llu syncs  %6llu sent  %6llu received  %6llu replies\n",
+           master ? "master" : "slave", quantum, elapsed / 1e6, emulated_s / (elapsed / 1e9),
+           (unsigned long long)link_socket.syncs, (unsigned long long)link_socket.bytes_sent,
+           (unsigned long long)link_socket.bytes_received, (unsigned long long)replies);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv){
+    int frames = argc > 1 ? atoi(argv[1]) : 600;
+    const int quanta[] = { 512, SERIAL_CYCLES_PER_BIT * 8, CYCLES_PER_FRAME / 4, CYCLES_PER_FRAME };
+
+    InitializeInstructionTable();
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/gameboy-link-bench-%d.sock", (int)getpid());
+
+    for(size_t i = 0; i < sizeof(quanta) / sizeof(quanta[0]); i++){
+        fflush(stdout); // the child must not inherit buffered output
+        pid_t child = fork();
+        if(child == 0){
+            run_side(false, path, quanta[i], frames);
+            exit(0);
+        }
+        run_side(true, path, quanta[i], frames);
+        waitpid(child, NULL, 0);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+/* Example reader of the shared memory export (--shm=<name>). Polls the 
+   segment without any system call, consumes every new frame in place (a 
+   checksum of the pixels and of WRAM stands for the real work) and prints
+   every second how many frames were read, skipped or found being written.
+   At the end the last frame is printed as text.
+
+   Usage: ./shm_reader [name] [seconds] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/system/shm_export.h"
+#include "../src/system/pacing.h"
+
+static uint64_t checksum(const SHM_EXPORT_SLOT *slot){
+    uint64_t sum = 0;
+    const uint8_t *pixels = &slot->pixels[0][0];
+    for(size_t i = 0; i < sizeof(slot->pixels); i++) sum = sum * 31 + pixels[i];
+    for(size_t i = 0; i < sizeof(slot->wram); i++) sum = sum * 31 + slot->wram[i];
+    return sum;
+}
+
+static void print_frame(const uint8_t pixels[WINDOW_HEIGHT][WINDOW_WIDTH]){
+    const char shades[] = " .+#";
+    for(int y = 0; y < WINDOW_HEIGHT; y += 4){ // a character is about two pixels wide and four tall
+        for(int x = 0; x < WINDOW_WIDTH; x += 2) putchar(shades[pixels[y][x] & 0x03]);
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv){
+    const char *name = argc > 1 ? argv[1] : "/gameboy";
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+
+    const SHM_EXPORT_REGION *region = NULL;
+    for(int i = 0; i < 100 && region == NULL; i++){ // the emulator may still be starting
+        region = shm_export_attach(name);
+        if(region == NULL) usleep(100000);
+    }
+    if(region == NULL){
+        fprintf(stderr, "[ERROR] No emulator is exporting to %s\n", name);
+        return 1;
+    }
+
+    static uint8_t last_pixels[WINDOW_HEIGHT][WINDOW_WIDTH], pixels[WINDOW_HEIGHT][WINDOW_WIDTH];
+    uint64_t last_frame = 0, read = 0, skipped = 0, torn = 0, sum = 0;
+    uint64_t start = pacer_now_ns(), report = start + 1000000000ULL, end = start + seconds * 1000000000ULL;
+    uint64_t now;
+
+    while((now = pacer_now_ns()) < end){
+        uint64_t sequence;
+        const SHM_EXPORT_SLOT *slot = shm_export_read_begin(region, &sequence);
+
+        if(slot != NULL && slot->frame != last_frame){
+            uint64_t frame = slot->frame;
+            uint64_t frame_sum = checksum(slot);
+            // the frame printed at the end is copied before the check too, or it could be torn
+            bool keep = now + 1000000000ULL >= end;
+            if(keep) memcpy(pixels, slot->pixels, sizeof(pixels));
+            if(shm_export_read_end(slot, sequence)){
+                if(last_frame != 0 && frame > last_frame + 1) skipped += frame - last_frame - 1;
+                last_frame = frame;
+                sum += frame_sum;
+                read++;
+                if(keep) memcpy(last_pixels, pixels, sizeof(last_pixels));
+            }
+            else torn++; // overwritten while it was read, the next one will do
+        }
+
+        if(now >= report){
+            double elapsed = (now - start) / 1e9;
+            printf("[INFO] frame %llu: %.0f frames/s read (%.1f MB/s), %llu skipped, %llu torn\n",
+                   (unsigned long long)last_frame, read / elapsed,
+                   read * (double)(sizeof(slot->pixels) + sizeof(slot->wram)) / elapsed / 1e6,
+                   (unsigned long long)skipped, (unsigned long long)torn);
+            report += 1000000000ULL;
+        }
+    }
+
+    print_frame((const uint8_t (*)[WINDOW_WIDTH])last_pixels);
+    printf("[INFO] %llu frames read, checksum %016llx\n", (unsigned long long)read, (unsigned long long)sum);
+    shm_export_detach(region);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* Text drawing benchmark: draws a full memory viewer screen (48 rows of 16
+   bytes in hex and ASCII, about 3400 glyphs) with the offscreen renderer,
+   once through the font cache and once through the glyph atlas batches, and
+   reports draw calls and ms per frame, then how many pixels of the two
+   screens differ. Needs no display.
+
+   Usage: ./text_bench [font] [frames] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/gui/renderer.h"
+#include "../src/system/pacing.h"
+
+#define ROWS   48
+#define WIDTH  720
+#define HEIGHT (ROWS * 16)
+
+static char lines[ROWS][96];
+static uint32_t screens[2][HEIGHT][WIDTH];
+
+static void draw_screen(void){
+    r_clear(mu_color(30, 30, 30, 255));
+    for(int y = 0; y < ROWS; y++){
+        r_draw_text(lines[y], mu_vec2(4, y * 16), mu_color(230, 230, 230, 255));
+    }
+    r_present();
+}
+
+/* Runs the frames and keeps the last screen drawn in screen */
+static void run(const char *name, bool batching, int frames, uint32_t (*screen)[WIDTH]){
+    r_set_text_batching(batching);
+    draw_screen(); // warm up, glyphs and textures are created
+    r_take_draw_stats();
+
+    uint64_t start = pacer_now_ns();
+    for(int i = 0; i < frames; i++) draw_screen();
+    uint64_t elapsed = pacer_now_ns() - start;
+
+    RendererDrawStats stats = r_take_draw_stats();
+    printf("%-12s %8.1f glyphs %8.1f draw calls %8.3f ms per frame\n", name,
+           stats.glyphs / (double)frames, stats.draw_calls / (double)frames, elapsed / 1e6 / frames);
+
+    int width, height, pitch;
+    const uint32_t *pixels = r_get_offscreen_pixels(&width, &height, &pitch);
+    for(int y = 0; pixels != NULL && y < HEIGHT && y < height; y++){
+        memcpy(screen[y], pixels + y * pitch, (width < WIDTH ? width : WIDTH) * sizeof(uint32_t));
+    }
+}
+
+int main(int argc, char **argv){
+    const char *font_path = argc > 1 ? argv[1] : "src/gui/fonts/DejaVuSans.ttf";
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+
+    for(int y = 0; y < ROWS; y++){
+        int n = snprintf(lines[y], sizeof(lines[y]), "%04X ", 0xC000 + y * 16);
+        char ascii[17] = { 0 };
+        for(int x = 0; x < 16; x++){
+            int value = (y * 16 + x) * 37 & 0xFF; // stands for the memory content
+            n += snprintf(lines[y] + n, sizeof(lines[y]) - n, " %02X", value);
+            ascii[x] = value >= 0x20 && value < 0x7F ? value : '.';
+        }
+        snprintf(lines[y] + n, sizeof(lines[y]) - n, "  %s", ascii);
+    }
+
+    r_init("text bench", WIDTH, HEIGHT, font_path, false, R_BACKEND_OFFSCREEN);
+    run("font cache", false, frames, screens[0]);
+    run("atlas", true, frames, screens[1]);
+    r_quit();
+
+    int differ = 0;
+    for(int y = 0; y < HEIGHT; y++)
+        for(int x = 0; x < WIDTH; x++) differ += screens[0][y][x] != screens[1][y][x];
+    printf("%d of %d pixels differ between the two\n", differ, WIDTH * HEIGHT);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/* Converts an execution trace (written with --trace=<path>) to the text log
+   of gameboy-doctor, one line per instruction, to compare it with the logs
+   of the test ROMs. Those logs are taken with LY always reading 0x90, the
+   trace has to be recorded with --doctor to match them:
+     ./gameboy-headless --doctor --trace=gameboy.trace --frames=N 01-special.gb
+     ./trace_convert gameboy.trace | gameboy-doctor - cpu_instrs 1
+   With --cycles each line also gets the bank and the cycle the instruction
+   starts at, counted from power on as --trace-cycles does, which 
+   gameboy-doctor does not accept but is handy to read; it stays right across
+   the instructions a filter left out.
+
+   Usage: ./trace_convert <in.trace> [out.log] [--cycles] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/hardware/trace.h"
+
+#define CHUNK_RECORDS 4096
+
+int main(int argc, char **argv){
+    const char *in_path = NULL, *out_path = NULL;
+    bool cycles = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--cycles") == 0) cycles = true;
+        else if(in_path == NULL) in_path = argv[i];
+        else out_path = argv[i];
+    }
+    if(in_path == NULL){
+        fprintf(stderr, "[ERROR] Usage: ./trace_convert <in.trace> [out.log] [--cycles]\n");
+        return 1;
+    }
+
+    FILE *in = fopen(in_path, "rb");
+    if(in == NULL){
+        fprintf(stderr, "[ERROR] Cannot open %s\n", in_path);
+        return 1;
+    }
+    if(!trace_read_header(in)){
+        fprintf(stderr, "[ERROR] %s is not an execution trace\n", in_path);
+        return 1;
+    }
+    FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if(out == NULL){
+        fprintf(stderr, "[ERROR] Cannot create %s\n", out_path);
+        return 1;
+    }
+
+    static TRACE_RECORD records[CHUNK_RECORDS];
+    char line[128];
+    uint64_t count = 0, cycle = 0;
+    size_t n;
+    while((n = fread(records, sizeof(TRACE_RECORD), CHUNK_RECORDS, in)) > 0){
+        for(size_t i = 0; i < n; i++){
+            const TRACE_RECORD *r = &records[i];
+            if(!trace_cycle(r, &cycle)) continue; // a marker, not an instruction
+            int len = trace_format_doctor(r, line, sizeof(line));
+            if(cycles){
+                len += snprintf(line + len - 1, sizeof(line) - len + 1, " BANK:%02X CY:%llu\n", trace_bank(r), (unsigned long long)cycle) - 1;
+            }
+            fwrite(line, 1, len, out);
+            count++;
+        }
+    }
+
+    fclose(in);
+    if(out != stdout && fclose(out) != 0){
+        fprintf(stderr, "[ERROR] Cannot write %s\n", out_path);
+        return 1;
+    }
+    if(out_path != NULL) printf("[INFO] %llu instructions converted to %s\n", (unsigned long long)count, out_path);
+    return 0;
+}
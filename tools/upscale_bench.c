@@ -0,0 +1,87 @@
+/* Upscaler benchmark: scales the same 160x144 frame with every filter and 
+   every instruction set the CPU has, checks that the vector kernels give the
+   same output as the scalar ones and reports the time per frame. The frame is
+   what a ROM shows after some frames, or a test pattern without a ROM.
+
+   Usage: ./upscale_bench [path-to-ROM] [frames to run first] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/hardware/emulator.h"
+#include "../src/system/upscale.h"
+#include "../src/system/pacing.h"
+
+#define ITERATIONS 2000
+
+static const uint32_t shade_colors[4] = { 0xFFFFFFFF, 0xC0C0C0C0, 0x2C2C2C2C, 0x00000000 };
+
+static uint32_t frame[WINDOW_HEIGHT][WINDOW_WIDTH];
+static uint32_t reference[WINDOW_HEIGHT * UPSCALE_MAX_FACTOR][WINDOW_WIDTH * UPSCALE_MAX_FACTOR];
+static uint32_t out[WINDOW_HEIGHT * UPSCALE_MAX_FACTOR][WINDOW_WIDTH * UPSCALE_MAX_FACTOR];
+static UPSCALER upscaler;
+static EMULATOR emu;
+
+static void capture_frame_buffer(int x, int y, uint8_t color){
+    frame[y][x] = shade_colors[color & 0x03];
+}
+
+/* Diagonal stripes and circles, every kind of edge the filters look for */
+static void test_pattern(void){
+    for(int y = 0; y < WINDOW_HEIGHT; y++){
+        for(int x = 0; x < WINDOW_WIDTH; x++){
+            int dx = x - WINDOW_WIDTH / 2, dy = y - WINDOW_HEIGHT / 2;
+            int shade = ((x + y) / 7 + (dx * dx + dy * dy) / 300) & 0x03;
+            frame[y][x] = shade_colors[shade];
+        }
+    }
+}
+
+int main(int argc, char **argv){
+    if(argc > 1){
+        CARTRIDGE cart;
+        if(!cartridge_load(&cart, argv[1])){
+            fprintf(stderr, "[ERROR] Cannot open ROM %s\n", argv[1]);
+            return 1;
+        }
+        int frames = argc > 2 ? atoi(argv[2]) : 600;
+        InitializeInstructionTable();
+        emulator_init(&emu, &cart, capture_frame_buffer);
+        for(int i = 0; i < frames && emu.cpu.running; i++) emulator_run(&emu, 0, CYCLES_PER_FRAME);
+    }
+    else test_pattern();
+
+    UPSCALE_ISA best = upscale_best_isa();
+    printf("%-8s  %-6s  %8s  %s\n", "filter", "isa", "ms/frame", "output");
+
+    for(UPSCALE_FILTER filter = UPSCALE_NONE; filter < UPSCALE_FILTERS; filter++){
+        upscaler_init(&upscaler, filter);
+        int factor = upscaler_factor(&upscaler);
+        int out_width = WINDOW_WIDTH * factor, out_height = WINDOW_HEIGHT * factor;
+        int pitch = WINDOW_WIDTH * UPSCALE_MAX_FACTOR;
+
+        for(UPSCALE_ISA isa = UPSCALE_SCALAR; isa <= best; isa++){
+            upscaler_set_isa(&upscaler, isa);
+            memset(out, 0, sizeof(out));
+
+            uint64_t start = pacer_now_ns();
+            for(int i = 0; i < ITERATIONS; i++){
+                upscaler_run(&upscaler, &frame[0][0], WINDOW_WIDTH, &out[0][0], pitch);
+            }
+            uint64_t elapsed = pacer_now_ns() - start;
+
+            if(isa == UPSCALE_SCALAR) memcpy(reference, out, sizeof(out));
+            int mismatches = 0;
+            for(int y = 0; y < out_height; y++){
+                for(int x = 0; x < out_width; x++) mismatches += out[y][x] != reference[y][x];
+            }
+
+            printf("%-8s  %-6s  %8.4f  %dx%d", upscale_filter_name(filter), upscale_isa_name(isa),
+                   elapsed / 1e6 / ITERATIONS, out_width, out_height);
+            if(mismatches > 0) printf("  %d pixels differ from scalar", mismatches);
+            printf("\n");
+        }
+    }
+    return 0;
+}